@@ -0,0 +1,662 @@
+// Headless benchmarks for csg.hpp.
+//
+// Build and run:
+//   $ g++ -O2 -DNDEBUG -pthread -o bench bench.cpp
+// or, with the library compiled separately:
+//   $ g++ -O2 -DNDEBUG -DCSGHPP_SEPARATE_COMPILATION -pthread -o bench bench.cpp csg.cpp
+//   $ ./bench --benchmark_filter=op/ --benchmark_out=results.json
+//
+// Each benchmark is repeated until it has run for at least --benchmark_min_time
+// seconds. Results go to stdout (or --benchmark_out) as JSON in the layout of
+// Google Benchmark, so existing tools for comparing runs can be used on them.
+// A human readable table is printed to stderr.
+//
+// Options:
+//   --benchmark_filter=<regex>    run only benchmarks whose name matches
+//   --benchmark_min_time=<secs>   minimum time per benchmark (default 0.5)
+//   --benchmark_out=<file>        write the JSON there instead of stdout
+//   --benchmark_list_tests        print the benchmark names and exit
+//   --threads=<n>                 run the BSP passes on a pool of n threads
+
+#include "csg.hpp"
+#include "csg_io.h"
+#include "demo_scenes.h"
+
+#include <chrono>
+#include <ctime>
+#include <functional>
+#include <map>
+#include <regex>
+#include <string>
+#include <thread>
+
+#if defined(_MSC_VER)
+#include <intrin.h> // _ReadWriteBarrier
+#endif
+
+using namespace csghpp;
+
+struct State
+{
+	// Passed to every benchmark, which runs its workload inside
+	// while (state.keepRunning()) { ... }
+	// Setup that should not be measured goes before the loop or between
+	// pauseTiming() and resumeTiming().
+	State(size_t _maxIterations)
+		: maxIterations(_maxIterations)
+		, iterations(0)
+		, running(false)
+		, realTime(0)
+		, cpuTime(0)
+	{
+	}
+
+	bool keepRunning()
+	{
+		if (iterations == 0) resumeTiming();
+		if (iterations == maxIterations)
+		{
+			pauseTiming();
+			return false;
+		}
+		iterations++;
+		return true;
+	}
+
+	void pauseTiming()
+	{
+		if (!running) return;
+		realTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - realStart).count();
+		cpuTime += double(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+		running = false;
+	}
+
+	void resumeTiming()
+	{
+		if (running) return;
+		realStart = std::chrono::steady_clock::now();
+		cpuStart = std::clock();
+		running = true;
+	}
+
+	size_t maxIterations;
+	size_t iterations;
+	bool running;
+	std::chrono::steady_clock::time_point realStart;
+	std::clock_t cpuStart;
+	double realTime; // seconds
+	double cpuTime;  // seconds, of the whole process
+	// Extra values reported with the result, e.g. output sizes
+	std::map<std::string, double> counters;
+};
+
+struct Benchmark
+{
+	std::string name;
+	std::function<void(State&)> fn;
+};
+
+static std::vector<Benchmark>& registry()
+{
+	static std::vector<Benchmark> benchmarks;
+	return benchmarks;
+}
+
+static void add(const std::string& name, std::function<void(State&)> fn)
+{
+	registry().push_back(Benchmark{ name, std::move(fn) });
+}
+
+// Keep the optimizer from dropping a result
+#if defined(_MSC_VER)
+static const volatile void* volatile doNotOptimizeSink;
+#endif
+
+template<typename T>
+static void doNotOptimize(const T& value)
+{
+#if defined(_MSC_VER)
+	// No inline assembly on MSVC: publish the address through a volatile
+	// and keep the compiler from moving memory accesses across it
+	doNotOptimizeSink = &value;
+	_ReadWriteBarrier();
+#else
+	asm volatile("" : : "r"(&value) : "memory");
+#endif
+}
+
+static std::string str(int i)
+{
+	return std::to_string(i);
+}
+
+// Operands of the boolean operation benchmarks, a cube and a sphere that
+// overlap (as in makeThing2) with the given tessellation of the sphere.
+template<typename C = CSG>
+static C overlapCube()
+{
+	return C::cube(typename C::vec3(-.25f, -.25f, -.25f));
+}
+
+template<typename C = CSG>
+static C overlapSphere(int stacks, int slices)
+{
+	return C::sphere(typename C::vec3(.25f, .25f, .25f), 1.3f, stacks, slices);
+}
+
+template<typename C>
+static void reportMesh(State& state, const C& csg)
+{
+	state.counters["polygons"] = (double)csg.polygons.size();
+	state.counters["vertices"] = (double)csg.pool.size();
+}
+
+static const char* splitterName(eSplitter s)
+{
+	switch (s)
+	{
+	case SPLIT_FIRST: return "first";
+	case SPLIT_RANDOM: return "random";
+	case SPLIT_COST: return "cost";
+	case SPLIT_AXIS_ALIGNED: return "axis_aligned";
+	}
+	return "?";
+}
+
+static const char* precisionName(ePrecision p)
+{
+	switch (p)
+	{
+	case PRECISION_FLOAT: return "float";
+	case PRECISION_DOUBLE: return "double";
+	case PRECISION_EXACT_PLANE: return "exact_plane";
+	}
+	return "?";
+}
+
+static void registerBenchmarks()
+{
+	// Primitive generation
+	add("gen/cube", [](State& state) {
+		while (state.keepRunning()) doNotOptimize(CSG::cube());
+	});
+	for (int res : { 8, 16, 32, 64 })
+	{
+		add("gen/sphere/" + str(res) + "x" + str(res * 2), [res](State& state) {
+			while (state.keepRunning()) doNotOptimize(CSG::sphere(vec3(0.f), 1.f, res, res * 2));
+		});
+		add("gen/cylinder/" + str(res * 2), [res](State& state) {
+			while (state.keepRunning()) doNotOptimize(CSG::cylinder(1.f, vec3(0.f, -1.f, 0.f), vec3(0.f, 1.f, 0.f), res * 2));
+		});
+	}
+
+	// Boolean operations, including the copy of the lvalue operands
+	for (int res : { 8, 16, 32 })
+	{
+		std::string suffix = "/cube_sphere" + str(res) + "x" + str(res * 2);
+		add("op/union" + suffix, [res](State& state) {
+			CSG a = overlapCube(), b = overlapSphere(res, res * 2), c;
+			while (state.keepRunning()) c = a.unionOp(b);
+			reportMesh(state, c);
+		});
+		add("op/sub" + suffix, [res](State& state) {
+			CSG a = overlapCube(), b = overlapSphere(res, res * 2), c;
+			while (state.keepRunning()) c = a.subOp(b);
+			reportMesh(state, c);
+		});
+		add("op/intersect" + suffix, [res](State& state) {
+			CSG a = overlapCube(), b = overlapSphere(res, res * 2), c;
+			while (state.keepRunning()) c = a.intersectOp(b);
+			reportMesh(state, c);
+		});
+	}
+
+	// Drilling holes into one body, one subOp at a time or all in one call
+	for (int holes : { 8, 32 })
+	{
+		std::vector<CSG> tools;
+		for (int i = 0; i < holes; i++)
+		{
+			real x = -1.5f + 3.f * (i % 8) / 7.f;
+			real z = -1.5f + 3.f * (i / 8) / 7.f;
+			tools.push_back(CSG::cylinder(0.15f, vec3(x, 1.5f, z), vec3(x, -0.5f, z)));
+		}
+		add("op/sub_chain/holes" + str(holes), [tools](State& state) {
+			CSG body = CSG::cube(vec3(0.f), vec3(2.f, 1.f, 2.f)), c;
+			while (state.keepRunning())
+			{
+				c = body;
+				for (const CSG& t : tools) c = std::move(c).subOp(t);
+			}
+			reportMesh(state, c);
+		});
+		add("op/sub_batch/holes" + str(holes), [tools](State& state) {
+			CSG body = CSG::cube(vec3(0.f), vec3(2.f, 1.f, 2.f)), c;
+			while (state.keepRunning()) c = body.subOp(tools);
+			reportMesh(state, c);
+		});
+	}
+
+	// A long chain of mixed operations, with and without merging fragments
+	// after each operation (Options::mergeFragments)
+	for (bool merge : { false, true })
+	{
+		add(std::string("op/mixed_chain/") + (merge ? "merged" : "plain") + "/spheres30", [merge](State& state) {
+			Options options;
+			options.mergeFragments = merge;
+			CSG c;
+			while (state.keepRunning())
+			{
+				c = CSG::cube(vec3(0.f), 2.f);
+				for (int i = 0; i < 30; i++)
+				{
+					real a = i * 0.7f;
+					CSG s = CSG::sphere(vec3(std::cos(a) * 1.6f, std::sin(a) * 1.6f, (i % 5) * 0.5f - 1.f), 0.6f, 8, 16);
+					c = (i % 3 == 2) ? std::move(c).unionOp(s, options) : std::move(c).subOp(s, options);
+				}
+			}
+			reportMesh(state, c);
+		});
+	}
+
+	// Union of many operands, chained or as one unionAll. The row of spheres
+	// overlaps throughout, the grid of bolts falls apart into small groups.
+	{
+		std::vector<CSG> spheres, bolts;
+		for (int i = 0; i < 32; i++)
+		{
+			spheres.push_back(CSG::sphere(vec3(i * 0.3f, 0.1f * (i % 3), 0.f), 0.5f, 6, 12));
+		}
+		for (int i = 0; i < 64; i++)
+		{
+			vec3 p = vec3((i % 8) * 1.f + 0.05f * (i % 3), 0.f, (i / 8) * 1.f);
+			bolts.push_back(CSG::cylinder(0.1f, p, p + vec3(0.f, 1.f, 0.f), 12));
+			bolts.push_back(CSG::cylinder(0.25f, p + vec3(0.f, 0.9f, 0.f), p + vec3(0.f, 1.1f, 0.f), 12));
+		}
+		std::pair<const char*, std::vector<CSG> > sets[] = { { "spheres32", spheres }, { "bolts64", bolts } };
+		for (const auto& set : sets)
+		{
+			std::vector<CSG> parts = set.second;
+			add(std::string("op/union_chain/") + set.first, [parts](State& state) {
+				CSG c;
+				while (state.keepRunning())
+				{
+					c = parts[0];
+					for (size_t i = 1; i < parts.size(); i++) c = std::move(c).unionOp(parts[i]);
+				}
+				reportMesh(state, c);
+			});
+			add(std::string("op/unionAll/") + set.first, [parts](State& state) {
+				CSG c;
+				while (state.keepRunning()) c = CSG::unionAll(parts);
+				reportMesh(state, c);
+			});
+		}
+	}
+
+	// BSP tree construction on its own, per splitter strategy
+	for (eSplitter splitter : { SPLIT_FIRST, SPLIT_RANDOM, SPLIT_COST, SPLIT_AXIS_ALIGNED })
+	{
+		add(std::string("bsp/build/") + splitterName(splitter) + "/sphere32x64", [splitter](State& state) {
+			Options options = Options::defaults();
+			options.splitter = splitter;
+			CSG s = overlapSphere(32, 64);
+			BuildStats stats;
+			while (state.keepRunning())
+			{
+				state.pauseTiming();
+				VertexPool pool = s.pool;
+				state.resumeTiming();
+				Node n(pool, s.polygons, options);
+				stats = n.buildStats();
+			}
+			state.counters["nodes"] = stats.nodes;
+			state.counters["depth"] = stats.depth;
+			state.counters["splits"] = stats.splits;
+		});
+	}
+
+	// Arithmetic of the plane tests and splits, see Options::precision
+	for (ePrecision precision : { PRECISION_FLOAT, PRECISION_DOUBLE, PRECISION_EXACT_PLANE })
+	{
+		std::string name = precisionName(precision);
+		add("precision/" + name + "/bsp_build/sphere32x64", [precision](State& state) {
+			Options options = Options::defaults();
+			options.precision = precision;
+			CSG s = overlapSphere(32, 64);
+			while (state.keepRunning())
+			{
+				state.pauseTiming();
+				VertexPool pool = s.pool;
+				state.resumeTiming();
+				Node n(pool, s.polygons, options);
+				doNotOptimize(n);
+			}
+		});
+		add("precision/" + name + "/sub/cube_sphere32x64", [precision](State& state) {
+			Options options = Options::defaults();
+			options.precision = precision;
+			CSG a = overlapCube(), b = overlapSphere(32, 64), c;
+			while (state.keepRunning()) c = a.subOp(b, options);
+			reportMesh(state, c);
+		});
+	}
+
+	// The same operation with float and with double coordinates
+	add("scalar/float/sub/cube_sphere32x64", [](State& state) {
+		CSG a = overlapCube(), b = overlapSphere(32, 64), c;
+		while (state.keepRunning()) c = a.subOp(b);
+		reportMesh(state, c);
+	});
+	add("scalar/double/sub/cube_sphere32x64", [](State& state) {
+		CSGd a = overlapCube<CSGd>(), b = overlapSphere<CSGd>(32, 64), c;
+		while (state.keepRunning()) c = a.subOp(b);
+		reportMesh(state, c);
+	});
+
+	// Vertex attribute streams: the default ones, and positions only
+	for (unsigned attributes : { unsigned(CSGHPP_DEFAULT_ATTRIBUTES), 0u })
+	{
+		std::string name = attributes ? "default" : "positions";
+		add("attributes/" + name + "/sub/cube_sphere32x64", [attributes](State& state) {
+			CSG a = overlapCube(), b = overlapSphere(32, 64), c;
+			a.setAttributes(attributes);
+			b.setAttributes(attributes);
+			while (state.keepRunning()) c = a.subOp(b);
+			reportMesh(state, c);
+		});
+	}
+
+	// Clipping one tree to another, without building them
+	add("bsp/clipTo/sphere32x64_cube", [](State& state) {
+		CSG a = overlapSphere(32, 64), b = overlapCube();
+		std::vector<Polygon> bPolygons = a.takeOperand(std::move(b));
+		while (state.keepRunning())
+		{
+			state.pauseTiming();
+			VertexPool pool = a.pool;
+			Node na(pool, a.polygons);
+			Node nb(pool, bPolygons);
+			state.resumeTiming();
+			na.clipTo(nb);
+		}
+	});
+
+	// Conversion to an indexed triangle mesh
+	{
+		CSG mesh = overlapCube().subOp(overlapSphere(32, 64));
+		add("mesh/fromPolygons", [mesh](State& state) {
+			Model m;
+			while (state.keepRunning()) m = fromPolygons(mesh);
+			state.counters["triangles"] = (double)m.index.size() / 3;
+			state.counters["vertices"] = (double)m.vertices.size();
+		});
+		add("mesh/fromPolygons/weld", [mesh](State& state) {
+			Model m;
+			while (state.keepRunning()) m = fromPolygons(mesh, 1e-3f);
+			state.counters["triangles"] = (double)m.index.size() / 3;
+			state.counters["vertices"] = (double)m.vertices.size();
+		});
+		add("mesh/fromPolygons/repair", [mesh](State& state) {
+			Model m;
+			MeshReport report;
+			MeshOptions options;
+			options.repair = true;
+			options.report = &report;
+			while (state.keepRunning()) m = fromPolygons(mesh, options);
+			state.counters["triangles"] = (double)m.index.size() / 3;
+			state.counters["tjunctions"] = (double)report.tJunctions;
+			state.counters["boundary_edges"] = (double)report.boundaryEdges;
+		});
+		add("mesh/fromPolygons/ear_clip_optimized", [mesh](State& state) {
+			Model m;
+			MeshOptions options;
+			options.triangulation = TRIANGULATE_EAR_CLIP;
+			options.optimizeOrder = true;
+			while (state.keepRunning()) m = fromPolygons(mesh, options);
+			state.counters["triangles"] = (double)m.index.size() / 3;
+			state.counters["acmr"] = cacheMissRatio(m);
+		});
+
+		Model model = fromPolygons(mesh);
+		double modelBytes = (double)(model.vertices.size() * sizeof(Vertex) + model.index.size() * sizeof(unsigned));
+		for (bool compact : { false, true })
+		{
+			add(std::string("mesh/pack/") + (compact ? "compact" : "float"), [model, modelBytes, compact](State& state) {
+				PackOptions options = compact ? PackOptions::compact() : PackOptions();
+				PackedMesh p;
+				while (state.keepRunning()) p = model.pack(options);
+				state.counters["bytes"] = (double)(p.vertices.size() + p.indices.size());
+				state.counters["shrink"] = modelBytes / (p.vertices.size() + p.indices.size());
+			});
+		}
+	}
+
+	// File I/O of a large mesh, through a file in the working directory
+	{
+		CSG mesh = overlapSphere(256, 512);
+		add("io/write_stl/sphere256x512", [mesh](State& state) {
+			while (state.keepRunning()) writeSTL("bench_io.stl", mesh);
+			std::remove("bench_io.stl");
+		});
+		add("io/read_stl/sphere256x512", [mesh](State& state) {
+			writeSTL("bench_io.stl", mesh);
+			CSG c;
+			while (state.keepRunning()) readSTL("bench_io.stl", c);
+			std::remove("bench_io.stl");
+			reportMesh(state, c);
+		});
+		add("io/write_ply/sphere256x512", [mesh](State& state) {
+			while (state.keepRunning()) writePLY("bench_io.ply", mesh);
+			std::remove("bench_io.ply");
+		});
+		add("io/read_ply/sphere256x512", [mesh](State& state) {
+			writePLY("bench_io.ply", mesh);
+			CSG c;
+			while (state.keepRunning()) readPLY("bench_io.ply", c);
+			std::remove("bench_io.ply");
+			reportMesh(state, c);
+		});
+		// With its BSP tree, to compare with bsp/build/.../sphere32x64
+		add("io/read_snapshot/sphere32x64", [](State& state) {
+			writeSnapshot("bench_io.snap", overlapSphere(32, 64));
+			CSG c;
+			while (state.keepRunning()) readSnapshot("bench_io.snap", c);
+			std::remove("bench_io.snap");
+			reportMesh(state, c);
+		});
+	}
+
+	// The demo scenes, from primitive generation to the final result
+	const char* opNames[] = { "union", "sub", "intersect" };
+	for (int op = 0; op < 3; op++)
+	{
+		add(std::string("scene/cylinders/") + opNames[op], [op](State& state) {
+			CSG c;
+			while (state.keepRunning()) c = makeThing(0.f, 0.f, op);
+			reportMesh(state, c);
+		});
+	}
+	add("scene/cube_sub_sphere", [](State& state) {
+		CSG c;
+		while (state.keepRunning()) c = makeThing2();
+		reportMesh(state, c);
+	});
+	add("scene/cube_intersect_sphere", [](State& state) {
+		CSG c;
+		while (state.keepRunning()) c = makeThing3();
+		reportMesh(state, c);
+	});
+	add("scene/wikipedia", [](State& state) {
+		CSG c;
+		while (state.keepRunning()) c = makeThing4();
+		reportMesh(state, c);
+	});
+	add("scene/hollow_box", [](State& state) {
+		CSG c;
+		while (state.keepRunning()) c = makeThing5();
+		reportMesh(state, c);
+	});
+
+	// Expressions: evaluating from scratch, and again after editing one leaf
+	add("expr/wikipedia/full", [](State& state) {
+		std::shared_ptr<const CSG> c;
+		while (state.keepRunning())
+		{
+			CSGExpr sphere;
+			c = makeThing4Expr(sphere).evaluate();
+		}
+		reportMesh(state, *c);
+	});
+	add("expr/wikipedia/edit_sphere", [](State& state) {
+		CSGExpr sphere;
+		CSGExpr thing = makeThing4Expr(sphere);
+		std::shared_ptr<const CSG> c = thing.evaluate();
+		int step = 0;
+		while (state.keepRunning())
+		{
+			sphere.set(CSGExpr::sphere(vec3(0.f), 1.2f + 0.05f * (step++ % 4), 12).setColor(0, 0, 1));
+			c = thing.evaluate();
+		}
+		reportMesh(state, *c);
+	});
+}
+
+struct Result
+{
+	std::string name;
+	size_t iterations;
+	double realTime; // per iteration, seconds
+	double cpuTime;
+	std::map<std::string, double> counters;
+};
+
+// Run 'b' with a growing number of iterations until it takes at least minTime
+static Result run(const Benchmark& b, double minTime)
+{
+	size_t iterations = 1;
+	for (;;)
+	{
+		State state(iterations);
+		b.fn(state);
+		bool last = state.realTime >= minTime || iterations >= 1000000000;
+		if (last)
+		{
+			return Result{ b.name, iterations, state.realTime / iterations, state.cpuTime / iterations, state.counters };
+		}
+		// Aim a bit above minTime, growing by at most 10x per round
+		double multiplier = state.realTime > 0 ? minTime * 1.4 / state.realTime : 10.0;
+		multiplier = std::min(std::max(multiplier, 2.0), 10.0);
+		iterations = (size_t)(iterations * multiplier);
+	}
+}
+
+static std::string jsonString(const std::string& s)
+{
+	std::string out = "\"";
+	for (char c : s)
+	{
+		if (c == '"' || c == '\\') out += '\\';
+		out += c;
+	}
+	return out + "\"";
+}
+
+static void writeJson(FILE* f, const std::vector<Result>& results, unsigned threads)
+{
+	char date[64];
+	std::time_t now = std::time(nullptr);
+	std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+	fprintf(f, "{\n  \"context\": {\n");
+	fprintf(f, "    \"date\": \"%s\",\n", date);
+	fprintf(f, "    \"num_cpus\": %u,\n", std::thread::hardware_concurrency());
+	fprintf(f, "    \"csg_threads\": %u,\n", threads);
+#ifdef NDEBUG
+	fprintf(f, "    \"library_build_type\": \"release\"\n");
+#else
+	fprintf(f, "    \"library_build_type\": \"debug\"\n");
+#endif
+	fprintf(f, "  },\n  \"benchmarks\": [\n");
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const Result& r = results[i];
+		fprintf(f, "    {\n");
+		fprintf(f, "      \"name\": %s,\n", jsonString(r.name).c_str());
+		fprintf(f, "      \"run_type\": \"iteration\",\n");
+		fprintf(f, "      \"iterations\": %zu,\n", r.iterations);
+		fprintf(f, "      \"real_time\": %.6g,\n", r.realTime * 1e9);
+		fprintf(f, "      \"cpu_time\": %.6g,\n", r.cpuTime * 1e9);
+		for (const auto& c : r.counters)
+		{
+			fprintf(f, "      %s: %.6g,\n", jsonString(c.first).c_str(), c.second);
+		}
+		fprintf(f, "      \"time_unit\": \"ns\"\n");
+		fprintf(f, "    }%s\n", i + 1 < results.size() ? "," : "");
+	}
+	fprintf(f, "  ]\n}\n");
+}
+
+static bool flag(const char* arg, const char* name, std::string& value)
+{
+	size_t n = strlen(name);
+	if (strncmp(arg, name, n) != 0 || arg[n] != '=') return false;
+	value = arg + n + 1;
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	std::string filter = ".*", out, value;
+	double minTime = 0.5;
+	bool list = false;
+	unsigned threads = 0;
+	for (int i = 1; i < argc; i++)
+	{
+		if (flag(argv[i], "--benchmark_filter", value)) filter = value;
+		else if (flag(argv[i], "--benchmark_min_time", value)) minTime = atof(value.c_str());
+		else if (flag(argv[i], "--benchmark_out", value)) out = value;
+		else if (flag(argv[i], "--threads", value)) threads = (unsigned)atoi(value.c_str());
+		else if (strcmp(argv[i], "--benchmark_list_tests") == 0) list = true;
+		else
+		{
+			fprintf(stderr, "unknown argument %s\n", argv[i]);
+			return 1;
+		}
+	}
+
+	std::unique_ptr<ThreadPool> pool;
+	if (threads > 0)
+	{
+		pool.reset(new ThreadPool(threads));
+		Options::defaults().threads = Optionsd::defaults().threads = pool.get();
+	}
+
+	registerBenchmarks();
+	std::regex re(filter);
+	std::vector<Result> results;
+	if (!list) fprintf(stderr, "%-44s %14s %14s %12s\n", "Benchmark", "Time (us)", "CPU (us)", "Iterations");
+	for (const Benchmark& b : registry())
+	{
+		if (!std::regex_search(b.name, re)) continue;
+		if (list)
+		{
+			printf("%s\n", b.name.c_str());
+			continue;
+		}
+		results.push_back(run(b, minTime));
+		const Result& r = results.back();
+		fprintf(stderr, "%-44s %14.2f %14.2f %12zu\n", r.name.c_str(), r.realTime * 1e6, r.cpuTime * 1e6, r.iterations);
+	}
+	if (list) return 0;
+
+	FILE* f = out.empty() ? stdout : fopen(out.c_str(), "w");
+	if (!f)
+	{
+		fprintf(stderr, "cannot open %s\n", out.c_str());
+		return 1;
+	}
+	writeJson(f, results, threads);
+	if (f != stdout) fclose(f);
+	return 0;
+}
@@ -0,0 +1,581 @@
+// Self checks for csg.hpp: invariants the library promises, such as the
+// batched operations giving the same solid as the chained ones. Prints each
+// failed check and returns non-zero if there was one.
+//
+// Build and run:
+//   $ g++ -O2 -pthread -o check check.cpp && ./check
+// or, with the library compiled separately:
+//   $ g++ -O2 -DCSGHPP_SEPARATE_COMPILATION -pthread -o check check.cpp csg.cpp && ./check
+
+#include "csg.hpp"
+#include "csg_expr.h"
+#include "csg_io.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+using namespace csghpp;
+
+static int failures = 0;
+
+static void check(bool condition, const char* what)
+{
+	if (!condition)
+	{
+		printf("FAILED: %s\n", what);
+		failures++;
+	}
+}
+
+static bool finite(const CSG& csg)
+{
+	for (const Polygon& poly : csg.polygons)
+	{
+		for (unsigned vi : poly.vertices)
+		{
+			vec3 p = csg.pool.pos(vi);
+			if (!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z)) return false;
+		}
+	}
+	return true;
+}
+
+// Whether every polygon of 'csg' turns the same way at all its corners
+static bool convex(const CSG& csg)
+{
+	for (const Polygon& poly : csg.polygons)
+	{
+		size_t n = poly.vertices.size();
+		for (size_t k = 0; k < n; k++)
+		{
+			vec3 a = csg.pool.pos(poly.vertices[k]);
+			vec3 b = csg.pool.pos(poly.vertices[(k + 1) % n]);
+			vec3 c = csg.pool.pos(poly.vertices[(k + 2) % n]);
+			if (dot(cross(b - a, c - b), poly.plane.normal) < -1e-5f) return false;
+		}
+	}
+	return true;
+}
+
+static bool near(double a, double b, double tolerance)
+{
+	return fabs(a - b) <= tolerance * std::max(1.0, std::max(fabs(a), fabs(b)));
+}
+
+// Signed volume enclosed by the triangles of 'm'
+template<typename real>
+static double volume(const ModelT<real>& m)
+{
+	double v = 0;
+	for (size_t t = 0; t + 2 < m.index.size(); t += 3)
+	{
+		tvec3<real> a = m.vertices[m.index[t]].pos, b = m.vertices[m.index[t + 1]].pos, c = m.vertices[m.index[t + 2]].pos;
+		v += (double)dot(a, cross(b, c));
+	}
+	return v / 6;
+}
+
+template<typename real>
+static double volume(const CSGT<real>& csg)
+{
+	return volume(fromPolygons(csg));
+}
+
+// Total area of 'polygons'
+static double area(const VertexPool& pool, const std::vector<Polygon>& polygons)
+{
+	double sum = 0;
+	for (const Polygon& poly : polygons)
+	{
+		vec3 first = pool.pos(poly.vertices[0]);
+		for (size_t k = 2; k < poly.vertices.size(); k++)
+		{
+			sum += cross(pool.pos(poly.vertices[k - 1]) - first, pool.pos(poly.vertices[k]) - first).length() / 2;
+		}
+	}
+	return sum;
+}
+
+// Area of 'polygons' on each plane, which tells two sets of polygons apart
+// however they are split into fragments
+static std::map<std::tuple<long, long, long, long>, double> planeAreas(const VertexPool& pool, const std::vector<Polygon>& polygons)
+{
+	std::map<std::tuple<long, long, long, long>, double> areas;
+	auto key = [](real x) { return lround(x * 1000); };
+	for (const Polygon& poly : polygons)
+	{
+		const Plane& p = poly.plane;
+		areas[std::make_tuple(key(p.normal.x), key(p.normal.y), key(p.normal.z), key(p.w))] += area(pool, std::vector<Polygon>(1, poly));
+	}
+	return areas;
+}
+
+static bool sameAreas(std::map<std::tuple<long, long, long, long>, double> x, std::map<std::tuple<long, long, long, long>, double> y)
+{
+	for (auto& item : x)
+	{
+		if (fabs(item.second - y[item.first]) > 1e-4) return false;
+	}
+	for (auto& item : y)
+	{
+		if (fabs(item.second - x[item.first]) > 1e-4) return false;
+	}
+	return true;
+}
+
+static bool sameSurface(const CSG& a, const CSG& b)
+{
+	return sameAreas(planeAreas(a.pool, a.polygons), planeAreas(b.pool, b.polygons));
+}
+
+static void putLE(std::string& out, uint32_t v)
+{
+	for (int k = 0; k < 4; k++) out += (char)(v >> (8 * k));
+}
+
+static void checkTreeCache()
+{
+	// Holes through a body, subtracted at once and one at a time
+	CSG body = CSG::cube(vec3(0.f), vec3(2.f, 1.f, 2.f));
+	std::vector<CSG> tools;
+	for (int i = 0; i < 8; i++)
+	{
+		real x = -1.5f + 0.4f * i;
+		tools.push_back(CSG::cylinder(0.1f, vec3(x, 0.3f, -3.f), vec3(x, 0.3f, 3.f)));
+	}
+	tools.push_back(CSG::sphere(vec3(2.f, 1.f, 2.f), 0.8f));
+
+	CSG chain = body;
+	for (const CSG& tool : tools) chain = std::move(chain).subOp(tool);
+	CSG batch = body.subOp(tools);
+	check(near(volume(batch), volume(chain), 1e-4), "batched subOp gives the volume of chained ones");
+	check(batch.cachedTree() != nullptr, "batched subOp keeps the tree of the body");
+	check(near(volume(batch.subOp(CSG::sphere(vec3(0.f, 1.f, 0.f), 0.7f))),
+		volume(CSG(batch.pool, batch.polygons).subOp(CSG::sphere(vec3(0.f, 1.f, 0.f), 0.7f))), 1e-4),
+		"an operation on a cached tree gives the volume of a fresh one");
+
+	// Non-convex and overlapping tools, through a non-convex body, so that
+	// tools remove whole cells of the kept tree
+	CSG notched = CSG::cube(vec3(0.f), vec3(2.f, 1.f, 2.f)).subOp(CSG::cube(vec3(1.f, 0.5f, 1.f), vec3(0.6f)));
+	unsigned seed = 7;
+	auto random = [&seed]() { seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5; return (seed % 10000) / 10000.f; };
+	bool same = true, kept = false;
+	for (int trial = 0; trial < 60; trial++)
+	{
+		std::vector<CSG> shapes;
+		for (int i = 0; i < 2 + trial % 10; i++)
+		{
+			vec3 c(random() * 4 - 2, random() * 2 - 1, random() * 4 - 2);
+			switch ((int)(random() * 4))
+			{
+			case 0: shapes.push_back(CSG::cube(c, vec3(0.6f, 0.2f, 0.2f)).unionOp(CSG::cube(c + vec3(0.4f, 0.4f, 0.f), vec3(0.2f, 0.6f, 0.2f)))); break;
+			case 1: shapes.push_back(CSG::cube(c, vec3(0.5f)).subOp(CSG::cylinder(0.3f, c - vec3(0.f, 1.f, 0.f), c + vec3(0.f, 1.f, 0.f)))); break;
+			case 2: shapes.push_back(CSG::cube(c, vec3(0.6f)).subOp(CSG::cube(c + vec3(0.3f), vec3(0.4f)))); break;
+			default: shapes.push_back(CSG::cylinder(0.3f, c - vec3(1.5f, 0.2f, 0.3f), c + vec3(1.5f, 0.1f, 0.2f))); break;
+			}
+		}
+		CSG chained = notched;
+		for (const CSG& shape : shapes) chained = std::move(chained).subOp(shape);
+		CSG batched = notched.subOp(shapes);
+		kept = kept || batched.cachedTree() != nullptr;
+		same = same && near(volume(batched), volume(chained), 1e-4) && sameSurface(batched, chained);
+	}
+	check(same, "batched subOp of non-convex, overlapping tools gives the polygons of chained ones");
+	check(kept, "batched subOp of non-convex tools keeps trees");
+
+	// setColor keeps the cached tree, its polygons are those of the CSG
+	batch.setColor(1.f, 0.f, 0.f);
+	check(batch.cachedTree() != nullptr, "setColor keeps the cached tree");
+
+	// Removing a polygon without invalidate() no longer matches the tree
+	CSG edited = CSG::cube();
+	edited.tree();
+	edited.polygons.pop_back();
+	check(!edited.treeMatches(), "a cached tree does not match edited polygons");
+	edited.invalidate();
+	edited.tree();
+	check(edited.treeMatches(), "a rebuilt tree matches the polygons");
+}
+
+// Appends the polygons of 'from' to 'to', tagged with 'shared'
+static std::vector<Polygon> append(CSG& to, const CSG& from, unsigned shared)
+{
+	std::vector<Polygon> added;
+	for (const Polygon& poly : from.polygons)
+	{
+		std::vector<Vertex> verts;
+		for (unsigned vi : poly.vertices) verts.push_back(from.pool.vertex(vi));
+		to.addPolygon(verts, shared);
+		added.push_back(to.polygons.back());
+	}
+	return added;
+}
+
+static void checkTreeEdits()
+{
+	// A sphere and a cube apart from it, and a tool through both
+	CSG scene = CSG::sphere(vec3(0.f), 1.f, 12, 24);
+	for (Polygon& poly : scene.polygons) poly.shared = 1;
+	std::vector<Polygon> sphere = scene.polygons;
+	append(scene, CSG::cube(vec3(3.f, 0.f, 0.f), 0.5f), 2);
+	std::vector<Polygon> tool = append(scene, CSG::cylinder(0.3f, vec3(-2.f, 0.f, 0.f), vec3(5.f, 0.f, 0.f)), 3);
+	std::vector<Polygon> both(scene.polygons.begin(), scene.polygons.end() - tool.size());
+
+	Options options;
+	options.rebalanceDepthGrowth = 2.f;
+	Node edited(scene.pool, both, options);
+	check(edited.remove(2) > 0, "remove finds the polygons with the ID");
+	Node rebuilt(scene.pool, sphere, options);
+	check(sameAreas(planeAreas(scene.pool, edited.allPolygons()), planeAreas(scene.pool, rebuilt.allPolygons())),
+		"a tree after remove lists the polygons of a tree of the rest");
+	check(sameAreas(planeAreas(scene.pool, edited.clipPolygons(tool)), planeAreas(scene.pool, rebuilt.clipPolygons(tool))),
+		"a tree after remove clips like a tree of the rest");
+
+	// Half the polygons, then the other half
+	std::vector<Polygon> half(both.begin(), both.begin() + both.size() / 2);
+	std::vector<Polygon> rest(both.begin() + both.size() / 2, both.end());
+	Node grown(scene.pool, half, options);
+	grown.insert(std::move(rest));
+	Node whole(scene.pool, both, options);
+	check(near(area(scene.pool, grown.allPolygons()), area(scene.pool, both), 1e-5), "insert keeps the area of the polygons");
+	check(sameAreas(planeAreas(scene.pool, grown.clipPolygons(tool)), planeAreas(scene.pool, whole.clipPolygons(tool))),
+		"a tree after insert clips like a tree of all polygons");
+}
+
+static void checkReductions()
+{
+	// Overlapping spheres in a ring, and one apart from the others
+	std::vector<CSG> shapes;
+	for (int i = 0; i < 12; i++)
+	{
+		real angle = i * real(PI) / 6;
+		shapes.push_back(CSG::sphere(vec3(1.5f * std::cos(angle), 0.2f * (i % 3), 1.5f * std::sin(angle)), 0.6f, 8, 16));
+	}
+	shapes.push_back(CSG::cube(vec3(5.f), 0.5f));
+
+	CSG chained = shapes[0];
+	for (size_t i = 1; i < shapes.size(); i++) chained = std::move(chained).unionOp(shapes[i]);
+	CSG all = CSG::unionAll(shapes);
+	check(near(volume(all), volume(chained), 1e-4) && sameSurface(all, chained), "unionAll gives the polygons of chained unions");
+
+	ThreadPool threads(4);
+	Options options;
+	options.threads = &threads;
+	options.parallelCutoff = 8;
+	CSG parallel = CSG::unionAll(shapes, options);
+	check(near(volume(parallel), volume(chained), 1e-4) && sameSurface(parallel, chained), "unionAll on threads gives the polygons of chained unions");
+
+	CSG body = CSG::cube(vec3(0.f), vec3(2.f, 0.5f, 2.f));
+	CSG cut = body;
+	for (const CSG& shape : shapes) cut = std::move(cut).subOp(shape);
+	CSG subtracted = CSG::subtractAll(body, shapes, options);
+	check(near(volume(subtracted), volume(cut), 1e-4) && sameSurface(subtracted, cut), "subtractAll gives the polygons of chained subtractions");
+}
+
+static void checkCylinder()
+{
+	// Along either direction of each axis and tilted, the volume is that of
+	// a prism with 'slices' sides
+	vec3 axes[] = { vec3(1.f, 0.f, 0.f), vec3(-1.f, 0.f, 0.f), vec3(0.f, 1.f, 0.f), vec3(0.f, -1.f, 0.f),
+		vec3(0.f, 0.f, 1.f), vec3(0.f, 0.f, -1.f), vec3(0.3f, -0.9f, 0.1f).unit() };
+	double prism = 8 * 0.25 * std::sin(2 * PI / 16) * 3;
+	bool ok = true;
+	for (vec3 axis : axes)
+	{
+		CSG c = CSG::cylinder(0.5f, vec3(1.f) - axis * 1.5f, vec3(1.f) + axis * 1.5f);
+		ok = ok && finite(c) && near(volume(c), prism, 1e-5);
+	}
+	check(ok, "cylinders along any axis have the volume of their prism");
+	CSG standard = CSG::cylinder();
+	check(near(volume(standard), 8 * std::sin(2 * PI / 16) * 2, 1e-5) && standard.bounds().min.y == -1.f,
+		"the default cylinder runs from y = -1 to 1");
+	check(near(volume(*CSGExpr::cylinder().evaluate()), volume(standard), 1e-6), "CSGExpr::cylinder() is CSG::cylinder()");
+}
+
+static void checkExpr()
+{
+	auto ball = CSGExpr::sphere(vec3(0.3f), 1.2f, 12, 24);
+	auto expr = CSGExpr::cube().subOp(ball);
+	check(near(volume(*expr.evaluate()), volume(CSG::cube().subOp(CSG::sphere(vec3(0.3f), 1.2f, 12, 24))), 1e-6),
+		"an expression gives the result of its operations");
+	ball.set(CSGExpr::sphere(vec3(0.3f), 1.1f, 12, 24));
+	check(near(volume(*expr.evaluate()), volume(CSG::cube().subOp(CSG::sphere(vec3(0.3f), 1.1f, 12, 24))), 1e-6),
+		"an edited expression gives the result of its new operations");
+
+	// Equal subexpressions share a result, distinct ones are told apart
+	auto a = CSGExpr::sphere(vec3(0.f), 1.f).subOp(CSGExpr::cube(vec3(0.5f), 0.5f));
+	auto b = CSGExpr::sphere(vec3(0.f), 1.f).subOp(CSGExpr::cube(vec3(0.5f), 0.5f));
+	auto c = CSGExpr::sphere(vec3(0.f), 1.f).subOp(CSGExpr::cube(vec3(-0.5f), 0.5f));
+	CSG sa = CSG::sphere(vec3(0.f), 1.f).subOp(CSG::cube(vec3(0.5f), 0.5f));
+	CSG sc = CSG::sphere(vec3(0.f), 1.f).subOp(CSG::cube(vec3(-0.5f), 0.5f));
+	auto ab = a.unionOp(b);
+	check(near(volume(*ab.evaluate()), volume(sa.unionOp(sa)), 1e-6), "equal subexpressions");
+	check(a.node->result == b.node->result, "equal subexpressions are evaluated once");
+	check(near(volume(*a.unionOp(c).evaluate()), volume(sa.unionOp(sc)), 1e-6), "distinct subexpressions");
+
+	// Expressions of doubles keep coordinates floats cannot tell apart
+	auto far = CSGExprd::cube(dvec3(1e6), 1.0).subOp(CSGExprd::cube(dvec3(1e6 + 0.5, 1e6, 1e6), dvec3(0.5 + 1e-3, 2.0, 2.0)));
+	CSGd direct = CSGd::cube(dvec3(1e6), 1.0).subOp(CSGd::cube(dvec3(1e6 + 0.5, 1e6, 1e6), dvec3(0.5 + 1e-3, 2.0, 2.0)));
+	check(far.evaluate()->bounds().max.x == direct.bounds().max.x && direct.bounds().max.x < 1e6 + 0.01,
+		"CSGExprd evaluates in double");
+}
+
+static void checkScalarTypes()
+{
+	// A slab 5e-5 thick at x = 1001, which floats cannot hold, cut with a
+	// tolerance below float precision
+	CSGd body = CSGd::cube(dvec3(1e3), 1.0);
+	CSGd tool = CSGd::cube(dvec3(1e3 + 2.0 - 5e-5, 1e3, 1e3), dvec3(1.0, 2.0, 2.0));
+	Optionsd options;
+	options.epsilon = 1e-9;
+	check(near(volume(body.subOp(tool, options)), 8.0 - 4 * 5e-5, 1e-7), "Optionsd takes tolerances below float precision");
+	check(near(volume(body.subOp(tool)), 8.0, 1e-7), "the default tolerance treats the slab as coplanar");
+}
+
+static void checkMeshFiles()
+{
+	// A sphere with a flipped copy of one polygon, sharing its vertices
+	CSG csg = CSG::sphere(vec3(0.f), 1.f, 8, 16);
+	Polygon back = csg.polygons[0];
+	back.flip();
+	csg.polygons.push_back(back);
+
+	std::string error;
+	CSG read;
+	bool ok = writePLY("check.ply", csg, &error) && readPLY("check.ply", read, &error);
+	remove("check.ply");
+	check(ok, "PLY round trip");
+	bool same = ok && read.polygons.size() == csg.polygons.size();
+	for (size_t i = 0; same && i < csg.polygons.size(); i++)
+	{
+		const Polygon& a = csg.polygons[i];
+		const Polygon& b = read.polygons[i];
+		same = a.vertices.size() == b.vertices.size();
+		for (size_t k = 0; same && k < a.vertices.size(); k++)
+		{
+			Vertex va = a.vertex(csg.pool, k), vb = b.vertex(read.pool, k);
+			same = (va.pos - vb.pos).length() == 0 && (va.normal - vb.normal).length() == 0;
+		}
+	}
+	check(same, "PLY keeps the normals of vertices shared by flipped and unflipped polygons");
+
+	CSG cut = CSG::cube().subOp(CSG::sphere(vec3(0.5f), 0.9f, 12, 24));
+	ok = writeSTL("check.stl", cut, &error) && readSTL("check.stl", read, &error);
+	remove("check.stl");
+	check(ok && near(volume(read), volume(cut), 1e-6), "STL round trip keeps the volume");
+
+	// Faces before the vertices they use
+	std::string ply = "ply\nformat binary_little_endian 1.0\n"
+		"element face 1\nproperty list uchar int vertex_indices\n"
+		"element vertex 3\nproperty float x\nproperty float y\nproperty float z\nend_header\n";
+	ply += (char)3;
+	for (uint32_t i = 0; i < 3; i++) putLE(ply, i);
+	float positions[9] = { 0, 0, 0, 1, 0, 0, 0, 1, 0 };
+	for (float p : positions)
+	{
+		uint32_t bits;
+		memcpy(&bits, &p, 4);
+		putLE(ply, bits);
+	}
+	CSG faces;
+	check(!parsePLY(ply.data(), ply.size(), faces), "PLY faces before vertices are rejected");
+}
+
+static void checkSnapshot()
+{
+	const char* path = "check.snap";
+	CSG csg = CSG::cube().subOp(CSG::sphere(vec3(0.3f), 1.2f, 12, 24));
+	csg.polygons[0].lineage = 7;
+	std::string error;
+	check(writeSnapshot(path, csg, true, &error), "writeSnapshot");
+
+	CSG read;
+	check(readSnapshot(path, read, &error), "readSnapshot");
+	check(read.cachedTree() != nullptr && read.treeMatches(), "a snapshot restores the tree");
+	bool same = read.polygons.size() == csg.polygons.size();
+	for (size_t i = 0; same && i < csg.polygons.size(); i++)
+	{
+		const Polygon& a = csg.polygons[i];
+		const Polygon& b = read.polygons[i];
+		same = a.vertices.size() == b.vertices.size() && a.shared == b.shared && a.flipped == b.flipped && a.lineage == b.lineage;
+		for (size_t k = 0; same && k < a.vertices.size(); k++)
+		{
+			same = (csg.pool.pos(a.vertices[k]) - read.pool.pos(b.vertices[k])).length() == 0;
+		}
+	}
+	check(same, "a snapshot keeps the polygons and their lineage");
+	CSG tool = CSG::cylinder(0.3f, vec3(0.f, -2.f, 0.f), vec3(0.2f, 2.f, 0.f));
+	check(near(volume(read.subOp(tool)), volume(csg.subOp(tool)), 1e-5), "an operation on a snapshot gives the same volume");
+
+	// A node that is the child of two nodes makes the tree a DAG
+	std::vector<unsigned char> bytes;
+	FILE* f = fopen(path, "rb");
+	if (f)
+	{
+		int c;
+		while ((c = fgetc(f)) != EOF) bytes.push_back((unsigned char)c);
+		fclose(f);
+	}
+	remove(path);
+	SnapshotHeader h;
+	bool ok = h.read(bytes.data(), bytes.size(), FileWriter::hostIsBigEndian(), &error) && h.nodes > 1;
+	check(ok, "snapshot header");
+	if (!ok) return;
+	unsigned char* children = bytes.data() + h.offsets[SnapshotHeader::NODES] + 4 * h.scalarSize;
+	for (int k = 0; k < 8; k++) children[k] = k % 4 == 0 ? 1 : 0; // front = back = node 1
+	CSG shared;
+	check(!parseSnapshot(bytes.data(), bytes.size(), shared), "a snapshot with a shared subtree is rejected");
+}
+
+static void checkMergeFragments()
+{
+	CSG csg = CSG::cube().subOp(CSG::sphere(vec3(0.5f), 0.9f, 12, 24));
+	for (int i = 0; i < 6; i++)
+	{
+		csg = std::move(csg).subOp(CSG::cylinder(0.1f, vec3(-0.6f + 0.25f * i, -2.f, -0.5f), vec3(-0.6f + 0.25f * i, 2.f, -0.5f)));
+	}
+	CSG before = csg;
+	size_t polygons = csg.polygons.size();
+	size_t removed = csg.mergeFragments();
+	check(removed > 0 && csg.polygons.size() == polygons - removed, "mergeFragments removes polygons");
+	check(near(volume(csg), volume(before), 1e-5) && sameSurface(csg, before), "mergeFragments keeps the surface");
+	check(convex(csg), "mergeFragments keeps the polygons convex");
+	check(csg.treeMatches(), "mergeFragments keeps a cached tree usable");
+}
+
+static void checkRepair()
+{
+	CSG csg = CSG::cube().subOp(CSG::sphere(vec3(0.5f), 1.f, 16, 32));
+	MeshReport report;
+	MeshOptions options;
+	options.repair = true;
+	options.report = &report;
+	Model repaired = fromPolygons(csg, options);
+	check(!checkWatertight(fromPolygons(csg)).watertight(), "cube - sphere has T-junctions before repair");
+	check(report.watertight(), "repair makes cube - sphere watertight");
+	check(near(volume(repaired), volume(csg), 1e-5), "repair keeps the volume");
+}
+
+// Triangles of 'm' as sorted position triples, each starting at its least
+// corner so that the winding counts but not the first vertex
+static std::vector< std::array<float, 9> > triangles(const Model& m)
+{
+	std::vector< std::array<float, 9> > out;
+	for (size_t t = 0; t + 2 < m.index.size(); t += 3)
+	{
+		std::array<float, 9> best;
+		for (int r = 0; r < 3; r++)
+		{
+			std::array<float, 9> tri;
+			for (int k = 0; k < 3; k++)
+			{
+				vec3 p = m.vertices[m.index[t + (r + k) % 3]].pos;
+				tri[3 * k] = p.x;
+				tri[3 * k + 1] = p.y;
+				tri[3 * k + 2] = p.z;
+			}
+			if (r == 0 || tri < best) best = tri;
+		}
+		out.push_back(best);
+	}
+	std::sort(out.begin(), out.end());
+	return out;
+}
+
+static void checkTriangulation()
+{
+	CSG csg = CSG::cube().subOp(CSG::sphere(vec3(0.5f), 1.f, 16, 32));
+	MeshOptions options;
+	options.repair = true;
+	options.triangulation = TRIANGULATE_EAR_CLIP;
+	Model ears = fromPolygons(csg, options);
+	check(near(volume(ears), volume(csg), 1e-5), "ear clipping keeps the volume");
+	check(checkWatertight(ears).watertight(), "ear clipping keeps the mesh watertight");
+
+	Model sphere = fromPolygons(CSG::sphere(vec3(0.f), 1.f, 64, 128));
+	Model ordered = sphere;
+	optimizeIndexOrder(ordered);
+	check(triangles(ordered) == triangles(sphere), "optimizeIndexOrder keeps the triangles and their winding");
+	check(cacheMissRatio(ordered) < cacheMissRatio(sphere), "optimizeIndexOrder lowers the cache miss ratio");
+}
+
+static void checkPack()
+{
+	// Compact packing stays within the precision of its formats
+	MeshOptions options;
+	options.repair = true;
+	Model m = fromPolygons(CSG::cube().subOp(CSG::sphere(vec3(0.5f), 1.f, 16, 32)), options);
+	PackedMesh p = m.pack(PackOptions::compact());
+	PackedMesh full = m.pack();
+	check(p.stride == 20 && p.indexSize == 2, "compact packing uses 20 byte vertices and 16 bit indices");
+	check(2 * p.vertices.size() < full.vertices.size(), "compact packing halves the vertex buffer");
+	bool decoded = p.vertexCount == m.vertices.size();
+	for (unsigned i = 0; decoded && i < p.vertexCount; i++)
+	{
+		const uint8_t* v = &p.vertices[(size_t)i * p.stride];
+		uint16_t h[3];
+		int16_t n[2];
+		memcpy(h, v + p.positionOffset, sizeof(h));
+		memcpy(n, v + p.normalOffset, sizeof(n));
+		vec3 pos(halfToFloat(h[0]), halfToFloat(h[1]), halfToFloat(h[2]));
+		vec3 normal = octahedralDecode<real>(n);
+		decoded = (pos - m.vertices[i].pos).length() < 2e-3f && dot(normal, m.vertices[i].normal.unit()) > 0.9999f;
+	}
+	check(decoded, "compact packing decodes to the positions and normals");
+	bool indices = p.indexCount == m.index.size();
+	for (size_t i = 0; indices && i < m.index.size(); i++)
+	{
+		uint16_t index;
+		memcpy(&index, &p.indices[2 * i], 2);
+		indices = index == m.index[i];
+	}
+	check(indices, "compact packing keeps the indices");
+}
+
+static void checkWeld()
+{
+	// The third vertex is within weldEpsilon of both others, and nearer the
+	// second
+	Model m(0.1f);
+	Vertex a, b, c;
+	b.pos = vec3(0.15f, 0.f, 0.f);
+	c.pos = vec3(0.09f, 0.f, 0.f);
+	unsigned ia = m.addVertex(a), ib = m.addVertex(b), ic = m.addVertex(c);
+	check(ia != ib && ic == ib, "welding picks the nearest vertex");
+
+	// Cells of these positions do not fit an int
+	Model far(1e-3f);
+	Vertex p, q, r;
+	p.pos = vec3(1e12f, -1e12f, 3e38f);
+	q.pos = vec3(-1e12f, 1e12f, -3e38f);
+	r.pos = vec3(INFINITY, 0.f, 0.f);
+	unsigned ip = far.addVertex(p), iq = far.addVertex(q), ir = far.addVertex(r);
+	check(ip != iq && iq != ir && far.addVertex(p) == ip && far.addVertex(q) == iq, "welding far from the origin");
+}
+
+int main()
+{
+	checkWeld();
+	checkCylinder();
+	checkTreeCache();
+	checkReductions();
+	checkTreeEdits();
+	checkExpr();
+	checkScalarTypes();
+	checkMeshFiles();
+	checkSnapshot();
+	checkMergeFragments();
+	checkRepair();
+	checkTriangulation();
+	checkPack();
+	if (failures) printf("%d checks failed\n", failures);
+	else printf("all checks passed\n");
+	return failures ? 1 : 0;
+}
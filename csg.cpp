@@ -0,0 +1,11 @@
+// Compiled part of csg.hpp, for builds with CSGHPP_SEPARATE_COMPILATION.
+//
+// Define CSGHPP_SEPARATE_COMPILATION for all translation units, this one
+// included, and link this file in. The BSP kernels and boolean operations
+// are then compiled here once, for float and double, instead of in every
+// translation unit that uses them:
+//   $ g++ -O2 -DCSGHPP_SEPARATE_COMPILATION -pthread -c csg.cpp
+//   $ g++ -O2 -DCSGHPP_SEPARATE_COMPILATION -pthread -o app app.cpp csg.o
+
+#define CSGHPP_IMPLEMENTATION
+#include "csg.hpp"
@@ -3,75 +3,124 @@
 #include <algorithm> // std::for_each
 #include <cassert>
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h> // for memcpy
 #include <vector> // for vector
 #include <deque> // to remember recursion in non-recursive version
 #include <memory> // for unique_ptr
 #include <math.h> // for M_PI
+#include <cmath>
+#include <atomic>
+#include <mutex>
+#include <limits>
+#include <initializer_list>
+#include <type_traits>
 
 #include "torb_vec.h"
+#include "csg_thread_pool.h"
+
+// Define CSGHPP_NO_SIMD to use only the scalar point classification kernel
+#if !defined(CSGHPP_NO_SIMD) && (defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86))
+#define CSGHPP_SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define CSGHPP_TARGET_AVX2
+#else
+#define CSGHPP_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// By default the library is header only and can be included in any number
+// of translation units. Define CSGHPP_SEPARATE_COMPILATION everywhere to
+// only declare the BSP kernels here; they are then compiled once, for float
+// and double, by csg.cpp, which defines CSGHPP_IMPLEMENTATION.
+#ifdef CSGHPP_SEPARATE_COMPILATION
+#define CSGHPP_INLINE
+#ifdef CSGHPP_IMPLEMENTATION
+#define CSGHPP_DEFINE_KERNELS 1
+#else
+#define CSGHPP_DEFINE_KERNELS 0
+#endif
+#else
+#define CSGHPP_INLINE inline
+#define CSGHPP_DEFINE_KERNELS 1
+#endif
 
 // This is a port of CSG.js
 // Written 7. Jan 2022 by Torbjoern
 
 namespace csghpp
 {
-	#define RECURSIVE 0
-	static const real PI = 3.14159265358979323846f;
+	static const double PI = 3.14159265358979323846;
+
+	// The library is templated on the scalar type of the coordinates, 'real'.
+	// Vertex, CSG etc. use the 'real' of torb_vec.h, Vertexd, CSGd etc. use
+	// double; see the end of this file.
+
+	// Scalar parameter that takes its type from the other arguments, so that
+	// e.g. a float epsilon can be passed along with double coordinates
+	template<typename T>
+	struct NonDeduced
+	{
+		typedef T type;
+	};
 
-	struct Vertex
+	template<typename real>
+	struct VertexT
 	{
-		Vertex() : pos(0.f), normal(0.f)
+		typedef tvec3<real> vec3;
+		typedef tvec2<real> vec2;
+
+		// A vertex with all attributes, as passed to CSG::addPolygon and
+		// stored in a Model. A VertexPool only stores the attributes it has.
+		VertexT() : pos(0.f), normal(0.f), color(1.f)
 		{}
 
-		Vertex(const Vertex& o)
-			: pos(o.pos)
-			, normal(o.normal)
-			, color(o.color)
-		{
-		}
-		Vertex(vec3 _pos, vec3 _normal, vec3 _color = vec3(1.f, 1.f, 1.f))
+		VertexT(vec3 _pos, vec3 _normal, vec3 _color = vec3(1.f, 1.f, 1.f), vec2 _uv = vec2(0.f))
 			: pos(_pos)
 			, normal(_normal)
 			, color(_color)
+			, uv(_uv)
 		{
 		}
 		void flip()
 		{
 			normal = -normal;
 		}
-		Vertex interpolate(Vertex b, real t) const
+		VertexT interpolate(VertexT b, real t) const
 		{
-			return Vertex(
+			return VertexT(
 				lerp(pos, b.pos, t),
 				lerp(normal, b.normal, t),
-				lerp(color , b.color, t)
+				lerp(color , b.color, t),
+				uv + (b.uv - uv) * t
 			);
 		}
 		vec3 pos;
 		vec3 normal;
 		vec3 color;
+		vec2 uv;
 	};
 
-	struct Plane
+	template<typename real>
+	struct PlaneT
 	{
-		Plane() : normal(0.f), w(0.f)
-		{
-		}
-		Plane(const Plane& o)
-			: normal(o.normal)
-			, w(o.w)
+		typedef tvec3<real> vec3;
+
+		PlaneT() : normal(0.f), w(0.f)
 		{
 		}
-		Plane(vec3 _normal, real _w)
+		PlaneT(vec3 _normal, real _w)
 			: normal(_normal), w(_w)
 		{
 		}
 
-		static Plane fromPoints(vec3 a, vec3 b, vec3 c)
+		static PlaneT fromPoints(vec3 a, vec3 b, vec3 c)
 		{
 			vec3 n = cross(b - a, c - a).unit();
-			float w = dot(n, a);
-			return Plane(n, w);
+			real w = dot(n, a);
+			return PlaneT(n, w);
 		}
 
 		bool ok() const
@@ -88,568 +137,3512 @@ namespace csghpp
 		real w;
 	};
 
-	struct Polygon
+	template<typename T>
+	struct SegmentedArray
 	{
-		// Represents a convex polygon.
-		// Vertices used to initialize must be coplanar and form a convex loop.
-		Polygon()
-			: vertices()
-			, plane(vec3(0.f), 0.f)
-			, shared(0)
+		// Append-only array stored in segments of doubling size that never move,
+		// so a reference to an element stays valid while more are appended.
+		// Appending is thread safe; an element may be read by another thread
+		// once it has been handed over, e.g. by finishing the task that wrote it.
+		enum : unsigned
 		{
-		}
+			FIRST_SEGMENT_BITS = 8,
+			SEGMENTS = 32 - FIRST_SEGMENT_BITS + 1,
+		};
 
-		Polygon(const std::vector<Vertex>& _vertices, int _shared = 0)
-			: vertices(_vertices)
-			, plane(Plane::fromPoints(_vertices[0].pos, _vertices[1].pos, _vertices[2].pos))
-			, shared(_shared)
+		SegmentedArray()
+			: count(0)
 		{
+			for (unsigned k = 0; k < SEGMENTS; k++) segments[k] = nullptr;
 		}
 
-		void flip()
+		SegmentedArray(const SegmentedArray& o)
+			: SegmentedArray()
 		{
-			std::reverse(vertices.begin(), vertices.end());
-			std::for_each(vertices.begin(), vertices.end(), [this](Vertex& v) { v.flip(); });
-			plane.flip();
+			for (unsigned i = 0; i < o.size(); i++) push_back(o[i]);
 		}
-		std::vector<Vertex> vertices;
-		Plane plane;
-		unsigned shared;
-	};
-
-	
-void splitPolygon(
-	const Plane& plane, // The splitting plane
-	const Polygon& polygon,
-	std::vector<Polygon>& coplanarFront,
-	std::vector<Polygon>& coplanarBack,
-	std::vector<Polygon>& front_polys,
-	std::vector<Polygon>& back_polys)
-{
-	enum ePolyType {
-		COPLANAR = 0,
-		FRONT = 1,
-		BACK = 2,
-		SPANNING = 3,
-	};
-	const char* string2type[] = {"COPLANAR", "FRONT", "BACK", "SPAN"};
 
-	// EPSILON is the tolerance used by 'splitPolygon' to decide 
-	// if a point is on the plane.
-	//static const real EPSILON = 1e-5;
-	static const real EPSILON = 1e-4f;
+		SegmentedArray(SegmentedArray&& o)
+			: SegmentedArray()
+		{
+			swap(o);
+		}
 
-	// Classify each point as well as the entire polygon into one of the above
-	// four classes.
+		SegmentedArray& operator=(SegmentedArray o)
+		{
+			swap(o);
+			return *this;
+		}
 
-	//vec3 n = plane.normal;
-	//printf( "Split poly with %d verts along plane{% .2f,% .2f,% .2f}. eps:%f\n", (int)polygon.vertices.size(), n.x, n.y, n.z, EPSILON);
+		~SegmentedArray()
+		{
+			clear();
+		}
 
-	unsigned polygonType = 0;
-	std::vector<ePolyType> types;
-	ePolyType type;
-	for (const Vertex& v : polygon.vertices)
-	{
-		real t = dot(plane.normal, v.pos) - plane.w;
-		ePolyType type = (t < -EPSILON) ? BACK : ((t > EPSILON) ? FRONT : COPLANAR);
-		polygonType |= type;
-		types.push_back(type);
-		//vec3 pos = polygon.vertices[i].pos;
-		//printf("vertex %d is {% .2f,% .2f,% .2f} is %s\n", i, pos.x, pos.y, pos.z, string2type[type] );
-	}
-	bool isInFront = false;
-	// Put the polygon in the correct list, splitting it when necessary.
-	switch (polygonType) {
-	case COPLANAR:
-		isInFront = (plane.normal.dot(polygon.plane.normal) > 0);
-		//printf("poly is co-planar because N dot P - w is 0 or almost 0. side of splitting plane: %s \n", isInFront ? "front" : "back");
-		(isInFront ? coplanarFront : coplanarBack).push_back(polygon);
-		break;
-	case FRONT:
-		//printf("Poly is in front of plane\n");
-		front_polys.push_back(polygon);
-		break;
-	case BACK:
-		//printf("Poly is in behind of plane\n");
-		back_polys.push_back(polygon);
-		break;
-	case SPANNING:
-		//printf("Poly spanning the plane\n");
-		std::vector<Vertex> fverts; 
-		std::vector<Vertex> bverts;
-		for (unsigned i = 0; i < polygon.vertices.size(); i++) 
+		void swap(SegmentedArray& o)
 		{
-			unsigned j = (i + 1) % polygon.vertices.size();
-			ePolyType ti = types[i];
-			ePolyType tj = types[j];
-			const Vertex& vi = polygon.vertices[i];
-			const Vertex& vj = polygon.vertices[j];
-			if (ti != BACK) fverts.push_back(vi);
-			if (ti != FRONT) bverts.push_back(vi);
-			if ((ti | tj) == SPANNING) {
-				real t = (plane.w - dot(plane.normal, vi.pos)) / dot(plane.normal, vj.pos - vi.pos);
-				Vertex v = vi.interpolate(vj, t);
-				fverts.push_back(v);
-				bverts.push_back(v);
+			for (unsigned k = 0; k < SEGMENTS; k++)
+			{
+				T* tmp = segments[k].load();
+				segments[k] = o.segments[k].load();
+				o.segments[k] = tmp;
 			}
+			unsigned tmp = count.load();
+			count = o.count.load();
+			o.count = tmp;
 		}
-		if (fverts.size() >= 3) front_polys.push_back( Polygon(fverts));
-		if (bverts.size() >= 3) back_polys.push_back( Polygon(bverts));
-		break;
-	}
-}
 
-	struct Node
-	{
-		// Holds a node in a BSP tree.
-		// A BSP tree is built from a collection of polygons
-		// by picking a polygon to split along. 
-		// That polygon (and all other coplanar polygons) are added directly to that node
-		// and the other polygons are added to the front and/or back subtrees.
-		// This is not a leafy BPS tree since there is no distinction
-		// between internal and leaf nodes.
-		Node()
-			: plane()
-			, front(nullptr)
-			, back(nullptr)
+		static unsigned segmentOf(unsigned i, unsigned& offset)
 		{
+			if (i < (1u << FIRST_SEGMENT_BITS))
+			{
+				offset = i;
+				return 0;
+			}
+			unsigned hb = highestBit(i);
+			offset = i - (1u << hb);
+			return hb - FIRST_SEGMENT_BITS + 1;
 		}
 
-		Node(const std::vector<Polygon>& in_polygons)
-			: plane()
-			, front(nullptr)
-			, back(nullptr)
+		static unsigned segmentSize(unsigned k)
 		{
-			build(in_polygons);
+			return k == 0 ? (1u << FIRST_SEGMENT_BITS) : (1u << (FIRST_SEGMENT_BITS + k - 1));
 		}
 
-		// Convert solid space to empty space and empty space to solid space.
-		void invert()
+		static unsigned highestBit(unsigned v)
 		{
-#if RECURSIVE == 1
-			std::for_each(polygons.begin(), polygons.end(), [this](Polygon& p) { p.flip(); });
-			plane.flip();
-			if (front) front->invert();
-			if (back) back->invert();
-			std::swap(front, back);
+#if defined(_MSC_VER)
+			unsigned long r;
+			_BitScanReverse(&r, v);
+			return (unsigned)r;
 #else
-			std::deque<Node*> nodes;
-			nodes.push_back(this);
-			while (!nodes.empty())
-			{
-				Node* n = nodes.front();
-				std::for_each(n->polygons.begin(), n->polygons.end(), [this](Polygon& p) { p.flip(); });
-				n->plane.flip();
-				if (n->front) nodes.push_back(n->front.get());
-				if (n->back) nodes.push_back(n->back.get());
-				std::swap(n->front, n->back);
-				nodes.pop_front();
-			}
+			return 31u - (unsigned)__builtin_clz(v);
 #endif
 		}
 
-		// Put all a copy of all polygons in 'b' into 'a'
-		static void concat(std::vector<Polygon>& a, const std::vector<Polygon>& b)
+		// Reserve the next element and return its index.
+		// Elements of a fresh segment are default constructed, elements reused
+		// after rewind() keep their old value.
+		unsigned grow()
 		{
-			a.insert(a.end(), b.begin(), b.end());
+			unsigned i = count.fetch_add(1, std::memory_order_relaxed);
+			allocate(i);
+			return i;
 		}
 
-		// Recursively remove all polys in 'polygons' that are inside this Node
-		std::vector<Polygon> clipPolygons(const std::vector<Polygon>& input)
+		// Element 'i', growing the array to include it. For arrays whose
+		// indices are handed out by another one, see VertexPool.
+		T& slot(unsigned i)
 		{
-#if RECURSIVE == 1
-			if (!plane.ok()) return input; // return a copy
-			std::vector<Polygon> pfront;
-			std::vector<Polygon> pback;
-			for (const Polygon& p : input)
-			{
-				splitPolygon(plane, p, pfront, pback, pfront, pback);
-			}
-			if (front) pfront = front->clipPolygons(pfront);
-			if (back) pback = back->clipPolygons(pback);
-			else pback.resize(0);
-			
-			
-			concat(pfront, pback);
-			return pfront;
-#else
-			std::vector<Polygon> sum;
-			std::deque<const Node*> nodes;
-			std::deque< std::vector<Polygon> > polylists;
-			nodes.push_back(this);
-			polylists.push_back(input);
+			unsigned n = count.load(std::memory_order_relaxed);
+			while (n <= i && !count.compare_exchange_weak(n, i + 1, std::memory_order_relaxed)) {}
+			return allocate(i);
+		}
 
-			while (nodes.empty() == false)
+		// Element 'i', allocating its segment if needed
+		T& allocate(unsigned i)
+		{
+			unsigned offset;
+			unsigned k = segmentOf(i, offset);
+			T* segment = segments[k].load(std::memory_order_acquire);
+			if (!segment)
 			{
-				const Node* n = nodes.front();
-				const std::vector<Polygon>& polys = polylists.front();
-				if ( !n->plane.ok() ) {
-					concat(sum, polys);
-					nodes.pop_front();
-					polylists.pop_front();
-					continue;
-				}
-
-				std::vector<Polygon> pfront, pback;
-				for (const Polygon& p : polys)
-				{
-					splitPolygon(n->plane, p, pfront, pback, pfront, pback);
-				}
-				if (n->front)
+				T* fresh = new T[segmentSize(k)];
+				T* expected = nullptr;
+				if (segments[k].compare_exchange_strong(expected, fresh, std::memory_order_acq_rel))
 				{
-					nodes.push_back(n->front.get());
-					polylists.push_back(pfront);
-				}
-				else {
-					concat(sum, pfront);
+					segment = fresh;
 				}
-
-				if (n->back)
+				else
 				{
-					nodes.push_back(n->back.get());
-					polylists.push_back(pback);
+					delete[] fresh; // another thread got there first
+					segment = expected;
 				}
-				nodes.pop_front();
-				polylists.pop_front();
 			}
-			return sum;
-#endif
+			return segment[offset];
 		}
 
-		// Remove all polygons in this BSP tree that are inside the other BSP tree 'bsp'
-		void clipTo(Node& bsp)
-		{
-#if RECURSIVE == 1
-			this->polygons = bsp.clipPolygons(this->polygons);
-			if (front) front->clipTo(bsp);
-			if (back) back->clipTo(bsp);
-#else
-		std::deque<Node*> nodes;
-		nodes.push_back(this);
-		while (nodes.empty() == false)
+		unsigned push_back(const T& v)
 		{
-			Node* n = nodes.front();
-			nodes.pop_front();
-			n->polygons = bsp.clipPolygons(n->polygons);
-			if (n->front) nodes.push_back(n->front.get());
-			if (n->back) nodes.push_back(n->back.get());
-		}
-#endif	
+			unsigned i = grow();
+			(*this)[i] = v;
+			return i;
 		}
 
-		// Return a list of all polys in this BSP tree.
-		std::vector<Polygon> allPolygons() const
+		T& operator[](unsigned i)
 		{
-#if RECURSIVE == 1
-			// Recursive
-			std::vector<Polygon> sum = polygons;
-			if (front) concat(sum, front->allPolygons());
-			if (back) concat(sum, back->allPolygons());
-			return sum;
-#else
-			std::vector<Polygon> sum;
-			std::deque<const Node*> nodes;
-			nodes.push_back(this);
-			while (nodes.empty() == false)
-			{
-				const Node* n = nodes.front();
-				nodes.pop_front();
-
-				//sum.insert(sum.end(), n->polygons.begin(), n->polygons.end());
-				concat(sum, n->polygons);
-				if (n->front) nodes.push_back(n->front.get());
-				if (n->back) nodes.push_back(n->back.get());
-			}
-			return sum;
-#endif			
+			unsigned offset;
+			unsigned k = segmentOf(i, offset);
+			return segments[k].load(std::memory_order_acquire)[offset];
 		}
 
-		// Build a BSP tree out of 'polygons' polygons
-		void build(const std::vector<Polygon>& input)
+		const T& operator[](unsigned i) const
 		{
-#if RECURSIVE == 1
-			if (input.empty()) return;
-			if (!plane.ok()) plane = input[0].plane;
-
-			std::vector<Polygon> pfront, pback;
-			//printf("node %p begin.\n");
+			unsigned offset;
+			unsigned k = segmentOf(i, offset);
+			return segments[k].load(std::memory_order_acquire)[offset];
+		}
 
-			for (Polygon& p: input)
-			{
-				splitPolygon(plane, p, this->polygons, this->polygons, pfront, pback);
-			}
-			if (pfront.empty() == false)
-			{
-				if (!front) front = std::unique_ptr<Node>(new Node);
-				front->build(pfront);
-			}
-			if (pback.empty() == false)
-			{
-				if (!back) back = std::unique_ptr<Node>(new Node);
-				back->build(pback);
-			}
-#else
-			if (input.empty()) return;
+		unsigned size() const { return count.load(std::memory_order_relaxed); }
 
-			std::deque<Node*> nodes;
-			std::deque< std::vector<Polygon> > polylists;
-			nodes.push_back(this);
-			polylists.push_back(input);
+		// Forget all elements but keep the storage for reuse.
+		void rewind()
+		{
+			count = 0;
+		}
 
-			std::vector<Polygon> pfront, pback;
-			while (nodes.empty() == false)
+		void clear()
+		{
+			for (unsigned k = 0; k < SEGMENTS; k++)
 			{
-				Node* n = nodes.front();
-				const std::vector<Polygon>& list = polylists.front();
-				assert(!list.empty() && "list of polys empty");
-				if (!n->plane.ok()) n->plane = list[0].plane;
-				
-				for (const Polygon& p : list)
-				{
-					splitPolygon( n->plane, p, n->polygons, n->polygons, pfront, pback);
-				}
-				if (pfront.empty() == false)
-				{
-					if (!n->front) {
-						n->front = std::make_unique<Node>();
-					}
-					nodes.push_back(n->front.get());
-					polylists.push_back(pfront);
-				}
-				if (pback.empty() == false)
-				{
-					if (!n->back) {
-						n->back = std::make_unique<Node>();
-					}
-					nodes.push_back(n->back.get());
-					polylists.push_back(pback);
-				}
-				nodes.pop_front();
-				polylists.pop_front();
-				pfront.clear();
-				pback.clear();
+				delete[] segments[k].load();
+				segments[k] = nullptr;
 			}
-#endif
-			//printf("node %p complete\n",(void*)this);
+			count = 0;
 		}
 
-		Plane plane;
-		std::unique_ptr<Node> front;
-		std::unique_ptr<Node> back;
-		std::vector< Polygon > polygons;
+		std::atomic<T*> segments[SEGMENTS];
+		std::atomic<unsigned> count;
 	};
-	
-	struct CSG {
-		CSG() { }
 
-		CSG(const std::vector<Polygon>& _polygons)
-			: polygons(_polygons)
+	template<typename T, unsigned N>
+	struct SmallVector
+	{
+		// Array that stores up to N elements in place and only allocates when
+		// it grows beyond that. Polygons rarely have more than a few vertices,
+		// so their index lists almost never touch the heap.
+		// Elements must be trivially copyable; they are not constructed.
+		static_assert(std::is_trivially_copyable<T>::value, "SmallVector elements are copied with memcpy");
+
+		SmallVector()
+			: count(0)
+			, capacity(N)
 		{
 		}
 
-		CSG unionOp(const CSG& other)
+		SmallVector(std::initializer_list<T> list)
+			: SmallVector()
 		{
-			Node a(polygons);
-			Node b(other.polygons);
-			a.clipTo(b);
-			b.clipTo(a);
-			b.invert();
-			b.clipTo(a);
-			b.invert();
-			a.build(b.allPolygons());
-			return CSG(a.allPolygons());
+			assign(list.begin(), (unsigned)list.size());
 		}
-		CSG subOp(const CSG& other)
+
+		SmallVector(const SmallVector& o)
+			: SmallVector()
 		{
-			Node a(polygons);
-			Node b(other.polygons);
-			a.invert();
-			a.clipTo(b);
-			b.clipTo(a);
-			b.invert();
-			b.clipTo(a);
-			b.invert();
-			a.build(b.allPolygons());
-			a.invert();
-			return CSG(a.allPolygons());
+			assign(o.data(), o.count);
 		}
-		CSG intersectOp(const CSG& other)
+
+		SmallVector(SmallVector&& o)
+			: count(o.count)
+			, capacity(o.capacity)
 		{
-			Node a(polygons);
-			Node b(other.polygons);
-			a.invert();
-			b.clipTo(a);
-			b.invert();
-			a.clipTo(b);
-			b.clipTo(a);
-			a.build(b.allPolygons());
-			a.invert();
-			return CSG(a.allPolygons());
+			if (o.capacity > N) heap = o.heap;
+			else memcpy(local, o.local, count * sizeof(T));
+			o.count = 0;
+			o.capacity = N;
 		}
 
-		static CSG cube(vec3 c = vec3(0.f), vec3 radius = 1.0f)
+		~SmallVector()
 		{
-			struct IndicesNormal
-			{
-				int indices[4];
-				vec3 normal;
-			};
-			IndicesNormal data[] = {
-		    { {0, 4, 6, 2}, vec3(-1, 0, 0) },
-		    { {1, 3, 7, 5}, vec3(+1, 0, 0) },
-		    { {0, 1, 5, 4}, vec3(0, -1, 0) },
-		    { {2, 6, 7, 3}, vec3(0, +1, 0) },
-		    { {0, 2, 3, 1}, vec3(0, 0, -1) },
-		    { {4, 5, 7, 6}, vec3(0, 0, +1) },
-			};
-			
-			std::vector<Polygon> polys;
-			for (int face=0; face<6; face++)
-			{
-				vec3 normal = data[face].normal;
-				std::vector<Vertex> verts;
-				for (int i : data[face].indices)
-				{
-					vec3 pos = vec3(
-						c.x + radius.x * real(2 * !!(i & 1) - 1),
-						c.y + radius.y * real(2 * !!(i & 2) - 1),
-						c.z + radius.z * real(2 * !!(i & 4) - 1)
-					);
-					verts.push_back(Vertex(pos, normal));
-				}
-				polys.push_back(Polygon(verts, 0));
-			}
+			if (capacity > N) delete[] heap;
+		}
 
-			return CSG( polys );
+		SmallVector& operator=(const SmallVector& o)
+		{
+			if (this != &o) assign(o.data(), o.count);
+			return *this;
 		}
-	
-	static CSG sphere(vec3 center = vec3(0.f), 
-		real radius = 1.0f, int stacks = 8, int slices = 16)
-	{
-		auto pointOnSphere = [&](real theta, real phi)
+
+		SmallVector& operator=(SmallVector&& o)
 		{
-			theta *= 2.f * PI;
-			phi *= 1.f * PI;
-			auto dir = vec3(
-				(real)cosf(theta) * sinf(phi),
-				(real)cosf(phi),
-				(real)sinf(theta) * sinf(phi)
-			);
-			return Vertex(center + (dir * radius), dir);
-		};
-		CSG csg;
-		std::vector<Polygon>& polygons = csg.polygons;
-		std::vector<Vertex> vertices;
-		for (real i = 0; i < slices; i++) {
-			for (real j = 0; j < stacks; j++) {
-				vertices.push_back(pointOnSphere(i / slices, j / stacks));
-				if (j > 0) vertices.push_back(pointOnSphere((i + 1) / slices, j / stacks));
-				if (j < stacks - 1) vertices.push_back(pointOnSphere((i + 1) / slices, (j + 1) / stacks));
-				vertices.push_back(pointOnSphere(i / slices, (j + 1) / stacks));
-				polygons.push_back(Polygon(vertices));
-				vertices.clear();
+			if (this != &o)
+			{
+				if (capacity > N) delete[] heap;
+				count = o.count;
+				capacity = o.capacity;
+				if (o.capacity > N) heap = o.heap;
+				else memcpy(local, o.local, count * sizeof(T));
+				o.count = 0;
+				o.capacity = N;
 			}
+			return *this;
 		}
-		return csg;
 
-	}
+		void assign(const T* values, unsigned n)
+		{
+			count = 0;
+			reserve(n);
+			memcpy(data(), values, n * sizeof(T));
+			count = n;
+		}
 
-	static CSG cylinder(real radius = 1.f, vec3 start = vec3(0.f-1.f,0.f), vec3 end = vec3(0.f, 1.f, 0.f) )
-	{
-		CSG csg;
-		std::vector<Polygon>& polygons = csg.polygons;
-		
-		vec3 ray = end - start;
-		int slices = 16;
-		vec3 axisZ = ray.unit();
-		bool isY = fabs(axisZ.y > 0.5f);
-		vec3 axisX = cross(vec3(isY, !isY, 0), axisZ).unit();
-		vec3 axisY = cross(axisX, axisZ).unit();
-		Vertex vstart = Vertex(start, -axisZ);
-		Vertex vend = Vertex(end, axisZ.unit());
-		
-		auto point = [&](int stack, real slice, real normalBlend)
+		void reserve(unsigned n)
 		{
-			real angle = slice * PI * 2.f;
-			vec3 out = axisX * cosf(angle) + (axisY * sinf(angle));
-			vec3 pos = start + (ray * stack) + (out * radius);
-			vec3 normal = out * (1.f - fabs(normalBlend)) + (axisZ * normalBlend);
-			return Vertex(pos, normal);
-		};
-		
-		for (int i = 0; i < slices; i++)
+			if (n <= capacity) return;
+			T* grown = new T[n];
+			memcpy(grown, data(), count * sizeof(T));
+			if (capacity > N) delete[] heap;
+			heap = grown;
+			capacity = n;
+		}
+
+		void push_back(T v)
 		{
-			real t0 = i / real(slices);
-			real t1 = (i + 1) / real(slices);
-			std::vector<Vertex> verts_a = { vstart, point(0, t0, -1.f), point(0, t1, -1.f) };
-			std::vector<Vertex> verts_b = { point(0, t1, 0.f), point(0, t0, 0.f), point(1, t0, 0.f), point(1, t1, 0.f) };
-			std::vector<Vertex> verts_c = { vend, point(1, t1, 1.f), point(1, t0, 1.f) };
-			polygons.push_back(Polygon(verts_a));
-			polygons.push_back(Polygon(verts_b));
-			polygons.push_back(Polygon(verts_c));
+			if (count == capacity) reserve(capacity * 2);
+			data()[count++] = v;
 		}
-		return csg;
-	}
 
-	void setColor(float r, float g, float b)
-	{
-		vec3 color = vec3(r, g, b);
-		for (Polygon& p : polygons)
+		void resize(unsigned n)
 		{
-			for (Vertex& v : p.vertices)
-			{
-				v.color = color;
-			}
+			reserve(n);
+			for (unsigned i = count; i < n; i++) data()[i] = T();
+			count = n;
 		}
-	}
 
-	std::vector<Polygon> polygons;
-	};
+		void clear() { count = 0; }
 
-	bool operator==(const Vertex& a, const Vertex& b)
-	{
+		T* data() { return capacity > N ? heap : local; }
+		const T* data() const { return capacity > N ? heap : local; }
+		unsigned size() const { return count; }
+		bool empty() const { return count == 0; }
+		T& operator[](unsigned i) { return data()[i]; }
+		const T& operator[](unsigned i) const { return data()[i]; }
+		T& back() { return data()[count - 1]; }
+		T* begin() { return data(); }
+		T* end() { return data() + count; }
+		const T* begin() const { return data(); }
+		const T* end() const { return data() + count; }
+
+		unsigned count;
+		unsigned capacity; // N while the elements are in 'local'
+		union
+		{
+			T local[N];
+			T* heap;
+		};
+	};
+
+	// Vertex indices of a polygon
+	typedef SmallVector<unsigned, 8> IndexList;
+
+	// Optional vertex attributes of a VertexPool
+	enum eAttribute {
+		ATTR_NORMAL = 1,
+		ATTR_COLOR = 2,
+		ATTR_UV = 4,
+	};
+
+// Attributes of new vertex pools. Define as 0 to only store positions.
+// It must be the same in all translation units, including csg.cpp.
+#ifndef CSGHPP_DEFAULT_ATTRIBUTES
+#define CSGHPP_DEFAULT_ATTRIBUTES (csghpp::ATTR_NORMAL | csghpp::ATTR_COLOR)
+#endif
+
+	template<typename real>
+	struct VertexPoolT
+	{
+		typedef tvec3<real> vec3;
+		typedef tvec2<real> vec2;
+		typedef VertexT<real> Vertex;
+
+		// Append-only vertex storage shared by all polygons of a CSG.
+		// Polygons refer to vertices by index, so splitting, copying and moving
+		// polygons only touches small index lists. Since the storage never moves,
+		// splitPolygon can append while holding references to other vertices,
+		// and parallel BSP passes can append from several threads.
+		// Every attribute is a stream of its own. Positions are always there,
+		// normals, colors, UVs (see eAttribute) and any number of user
+		// attributes of one real each only if the pool has them, so a pool of
+		// positions neither stores nor interpolates anything else.
+		VertexPoolT(unsigned _attributes = CSGHPP_DEFAULT_ATTRIBUTES, unsigned _userAttributes = 0)
+			: attributes(_attributes)
+			, user(_userAttributes)
+		{
+		}
+
+		bool has(unsigned attribute) const { return (attributes & attribute) != 0; }
+		unsigned userAttributes() const { return (unsigned)user.size(); }
+
+		// Add and drop streams. Added ones are filled with the defaults of
+		// Vertex for the existing vertices, user attributes with 0.
+		void setAttributes(unsigned _attributes, unsigned _userAttributes)
+		{
+			Vertex defaults;
+			unsigned n = size();
+			if (!(_attributes & ATTR_NORMAL)) normals.clear();
+			else if (!has(ATTR_NORMAL)) for (unsigned i = 0; i < n; i++) normals.slot(i) = defaults.normal;
+			if (!(_attributes & ATTR_COLOR)) colors.clear();
+			else if (!has(ATTR_COLOR)) for (unsigned i = 0; i < n; i++) colors.slot(i) = defaults.color;
+			if (!(_attributes & ATTR_UV)) uvs.clear();
+			else if (!has(ATTR_UV)) for (unsigned i = 0; i < n; i++) uvs.slot(i) = defaults.uv;
+			unsigned had = userAttributes();
+			user.resize(_userAttributes);
+			for (unsigned k = had; k < _userAttributes; k++)
+			{
+				for (unsigned i = 0; i < n; i++) user[k].slot(i) = 0;
+			}
+			attributes = _attributes;
+		}
+
+		unsigned add(const Vertex& v)
+		{
+			unsigned i = positions.grow();
+			positions[i] = v.pos;
+			if (has(ATTR_NORMAL)) normals.slot(i) = v.normal;
+			if (has(ATTR_COLOR)) colors.slot(i) = v.color;
+			if (has(ATTR_UV)) uvs.slot(i) = v.uv;
+			for (SegmentedArray<real>& u : user) u.slot(i) = 0;
+			return i;
+		}
+
+		// Append vertex 'j' of 'o' with the attributes of this pool
+		unsigned add(const VertexPoolT& o, unsigned j)
+		{
+			unsigned i = positions.grow();
+			positions[i] = o.positions[j];
+			if (has(ATTR_NORMAL)) normals.slot(i) = o.has(ATTR_NORMAL) ? o.normals[j] : Vertex().normal;
+			if (has(ATTR_COLOR)) colors.slot(i) = o.has(ATTR_COLOR) ? o.colors[j] : Vertex().color;
+			if (has(ATTR_UV)) uvs.slot(i) = o.has(ATTR_UV) ? o.uvs[j] : Vertex().uv;
+			for (unsigned k = 0; k < userAttributes(); k++)
+			{
+				user[k].slot(i) = k < o.userAttributes() ? o.user[k][j] : 0;
+			}
+			return i;
+		}
+
+		// Append the vertex at 'p' on the edge from vertex 'a' to 'b', with the
+		// attributes interpolated at 't' along the edge
+		unsigned addOnEdge(unsigned a, unsigned b, real t, vec3 p)
+		{
+			unsigned i = positions.grow();
+			positions[i] = p;
+			if (has(ATTR_NORMAL)) normals.slot(i) = lerp(normals[a], normals[b], t);
+			if (has(ATTR_COLOR)) colors.slot(i) = lerp(colors[a], colors[b], t);
+			if (has(ATTR_UV)) uvs.slot(i) = uvs[a] + (uvs[b] - uvs[a]) * t;
+			for (SegmentedArray<real>& u : user) u.slot(i) = u[a] + (u[b] - u[a]) * t;
+			return i;
+		}
+
+		// Append all vertices of 'o', returning the index of its first vertex here.
+		unsigned append(const VertexPoolT& o)
+		{
+			unsigned first = size();
+			for (unsigned i = 0; i < o.size(); i++) add(o, i);
+			return first;
+		}
+
+		vec3& pos(unsigned i) { return positions[i]; }
+		const vec3& pos(unsigned i) const { return positions[i]; }
+		vec3& normal(unsigned i) { assert(has(ATTR_NORMAL)); return normals[i]; }
+		vec3& color(unsigned i) { assert(has(ATTR_COLOR)); return colors[i]; }
+		vec2& uv(unsigned i) { assert(has(ATTR_UV)); return uvs[i]; }
+		real& userAttribute(unsigned i, unsigned k) { return user[k][i]; }
+		real userAttribute(unsigned i, unsigned k) const { return user[k][i]; }
+
+		// Vertex 'i' with all attributes, the defaults of Vertex for those
+		// this pool does not have
+		Vertex vertex(unsigned i) const
+		{
+			Vertex v;
+			v.pos = positions[i];
+			if (has(ATTR_NORMAL)) v.normal = normals[i];
+			if (has(ATTR_COLOR)) v.color = colors[i];
+			if (has(ATTR_UV)) v.uv = uvs[i];
+			return v;
+		}
+
+		unsigned size() const { return positions.size(); }
+
+		void clear()
+		{
+			positions.clear();
+			normals.clear();
+			colors.clear();
+			uvs.clear();
+			for (SegmentedArray<real>& u : user) u.clear();
+		}
+
+		unsigned attributes; // of eAttribute
+		SegmentedArray<vec3> positions;
+		SegmentedArray<vec3> normals;
+		SegmentedArray<vec3> colors;
+		SegmentedArray<vec2> uvs;
+		std::vector< SegmentedArray<real> > user;
+	};
+
+	template<typename real>
+	struct AABBT
+	{
+		typedef tvec3<real> vec3;
+
+		// Axis aligned bounding box. A default constructed box is empty.
+		AABBT()
+			: min(std::numeric_limits<real>::max())
+			, max(-std::numeric_limits<real>::max())
+		{
+		}
+
+		void add(vec3 p)
+		{
+			min = vec3(std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z));
+			max = vec3(std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z));
+		}
+
+		void add(const AABBT& o)
+		{
+			if (o.empty()) return;
+			add(o.min);
+			add(o.max);
+		}
+
+		bool empty() const
+		{
+			return min.x > max.x;
+		}
+
+		// True if the boxes overlap or are less than 'margin' apart
+		bool overlaps(const AABBT& o, real margin = 0.f) const
+		{
+			return
+				min.x <= o.max.x + margin && o.min.x <= max.x + margin &&
+				min.y <= o.max.y + margin && o.min.y <= max.y + margin &&
+				min.z <= o.max.z + margin && o.min.z <= max.z + margin;
+		}
+
+		// True if 'o' lies inside this box grown by 'margin'
+		bool contains(const AABBT& o, real margin = 0.f) const
+		{
+			return
+				o.min.x >= min.x - margin && o.max.x <= max.x + margin &&
+				o.min.y >= min.y - margin && o.max.y <= max.y + margin &&
+				o.min.z >= min.z - margin && o.max.z <= max.z + margin;
+		}
+
+		vec3 min;
+		vec3 max;
+	};
+
+	template<typename real>
+	struct PolygonT
+	{
+		typedef tvec3<real> vec3;
+		typedef VertexT<real> Vertex;
+		typedef PlaneT<real> Plane;
+		typedef VertexPoolT<real> VertexPool;
+		typedef AABBT<real> AABB;
+
+		// Represents a convex polygon.
+		// Vertices used to initialize must be coplanar and form a convex loop.
+		// 'vertices' holds indices into the VertexPool of the owning CSG.
+		// Flipping a polygon does not touch the shared vertices, instead
+		// 'flipped' tells that the normals of its vertices point the other way.
+		PolygonT()
+			: vertices()
+			, plane(vec3(0.f), 0.f)
+			, shared(0)
+			, flipped(false)
+			, lineage(0)
+		{
+		}
+
+		PolygonT(const VertexPool& pool, IndexList _vertices, int _shared = 0)
+			: vertices(std::move(_vertices))
+			, plane(Plane::fromPoints(pool.pos(vertices[0]), pool.pos(vertices[1]), pool.pos(vertices[2])))
+			, shared(_shared)
+			, flipped(false)
+			, lineage(0)
+		{
+		}
+
+		// Polygon whose plane is already known, e.g. from a file reader
+		PolygonT(IndexList _vertices, const Plane& _plane, unsigned _shared = 0)
+			: vertices(std::move(_vertices))
+			, plane(_plane)
+			, shared(_shared)
+			, flipped(false)
+			, lineage(0)
+		{
+		}
+
+		// Polygon that is part of 'parent', used for split fragments
+		PolygonT(IndexList _vertices, const PolygonT& parent, unsigned _lineage)
+			: vertices(std::move(_vertices))
+			, plane(parent.plane)
+			, shared(parent.shared)
+			, flipped(parent.flipped)
+			, lineage(_lineage)
+		{
+		}
+
+		// A lineage no polygon has yet
+		static unsigned newLineage()
+		{
+			static std::atomic<unsigned> next(0);
+			unsigned id = next.fetch_add(1, std::memory_order_relaxed) + 1;
+			return id ? id : newLineage();
+		}
+
+		void flip()
+		{
+			std::reverse(vertices.begin(), vertices.end());
+			flipped = !flipped;
+			plane.flip();
+		}
+
+		AABB bounds(const VertexPool& pool) const
+		{
+			AABB box;
+			for (unsigned vi : vertices) box.add(pool.pos(vi));
+			return box;
+		}
+
+		// Vertex 'i' as seen from this polygon, with its normal flipped if the polygon is
+		Vertex vertex(const VertexPool& pool, size_t i) const
+		{
+			Vertex v = pool.vertex(vertices[i]);
+			if (flipped) v.flip();
+			return v;
+		}
+
+		IndexList vertices;
+		Plane plane;
+		unsigned shared;
+		bool flipped;
+		// Shared by all fragments split off one polygon, 0 if it was never
+		// split. See CSG::mergeFragments().
+		unsigned lineage;
+	};
+
+	
+	// Classes of a point or polygon relative to a plane
+	enum ePolyType {
+		COPLANAR = 0,
+		FRONT = 1,
+		BACK = 2,
+		SPANNING = 3,
+	};
+
+	// The default tolerance used by 'splitPolygon' to decide if a point is
+	// on the plane, see Options::epsilon. It is the same for float and
+	// double, as it depends on the size of the model.
+	template<typename real>
+	inline real defaultEpsilon() { return real(1e-4); }
+
+	// How points are classified against planes and where edges are split,
+	// see Options::precision
+	enum ePrecision {
+		PRECISION_FLOAT,  // float arithmetic, with the SIMD kernels
+		PRECISION_DOUBLE, // distances and split points computed in double
+		PRECISION_EXACT_PLANE, // exact against the stored plane; SIMD float filter, exact near the plane
+	};
+
+	// Classify a polygon against a plane without splitting it
+	template<typename real>
+	unsigned classifyPolygon(const PlaneT<real>& plane, const PolygonT<real>& polygon, const VertexPoolT<real>& pool,
+		typename NonDeduced<real>::type eps = defaultEpsilon<real>())
+	{
+		unsigned polygonType = 0;
+		for (unsigned vi : polygon.vertices)
+		{
+			real t = dot(plane.normal, pool.pos(vi)) - plane.w;
+			polygonType |= (t < -eps) ? BACK : ((t > eps) ? FRONT : COPLANAR);
+		}
+		return polygonType;
+	}
+
+	// Point classification kernels.
+	// Each writes FRONT, BACK or COPLANAR for the 'n' points given as separate
+	// x, y and z arrays, computing the same values as classifyPolygon.
+	// The SIMD kernels are for float coordinates.
+	typedef void (*ClassifyPointsFn)(const float* x, const float* y, const float* z, unsigned n,
+		const PlaneT<float>& plane, float eps, unsigned char* sides);
+
+	template<typename real>
+	void classifyPointsScalar(const real* x, const real* y, const real* z, unsigned n,
+		const PlaneT<real>& plane, real eps, unsigned char* sides)
+	{
+		for (unsigned i = 0; i < n; i++)
+		{
+			real t = plane.normal.x * x[i] + plane.normal.y * y[i] + plane.normal.z * z[i] - plane.w;
+			sides[i] = (unsigned char)((t < -eps) ? BACK : ((t > eps) ? FRONT : COPLANAR));
+		}
+	}
+
+	// Classify with the fastest kernel the CPU supports
+	CSGHPP_INLINE void classifyPoints(const float* x, const float* y, const float* z, unsigned n,
+		const PlaneT<float>& plane, float eps, unsigned char* sides);
+
+	inline void classifyPoints(const double* x, const double* y, const double* z, unsigned n,
+		const PlaneT<double>& plane, double eps, unsigned char* sides)
+	{
+		classifyPointsScalar(x, y, z, n, plane, eps, sides);
+	}
+
+#if CSGHPP_DEFINE_KERNELS
+#ifdef CSGHPP_SIMD_X86
+	// Side bytes of 4 points from their front and back bit masks
+	CSGHPP_INLINE const unsigned* sideBytesTable()
+	{
+		static unsigned table[256];
+		static bool init = []()
+		{
+			for (unsigned front = 0; front < 16; front++)
+			for (unsigned back = 0; back < 16; back++)
+			{
+				unsigned char bytes[4];
+				for (unsigned k = 0; k < 4; k++)
+				{
+					bytes[k] = (unsigned char)(((front >> k) & 1) * FRONT | ((back >> k) & 1) * BACK);
+				}
+				memcpy(&table[front | (back << 4)], bytes, 4);
+			}
+			return true;
+		}();
+		(void)init;
+		return table;
+	}
+
+	CSGHPP_INLINE void classifyPointsSSE(const float* x, const float* y, const float* z, unsigned n,
+		const PlaneT<float>& plane, float eps, unsigned char* sides)
+	{
+		__m128 nx = _mm_set1_ps(plane.normal.x);
+		__m128 ny = _mm_set1_ps(plane.normal.y);
+		__m128 nz = _mm_set1_ps(plane.normal.z);
+		__m128 w = _mm_set1_ps(plane.w);
+		__m128 pos_eps = _mm_set1_ps(eps);
+		__m128 neg_eps = _mm_set1_ps(-eps);
+		const unsigned* table = sideBytesTable();
+		unsigned i = 0;
+		for (; i + 4 <= n; i += 4)
+		{
+			__m128 t = _mm_add_ps(_mm_mul_ps(nx, _mm_loadu_ps(x + i)), _mm_mul_ps(ny, _mm_loadu_ps(y + i)));
+			t = _mm_sub_ps(_mm_add_ps(t, _mm_mul_ps(nz, _mm_loadu_ps(z + i))), w);
+			int front = _mm_movemask_ps(_mm_cmpgt_ps(t, pos_eps));
+			int back = _mm_movemask_ps(_mm_cmplt_ps(t, neg_eps));
+			memcpy(sides + i, &table[front | (back << 4)], 4);
+		}
+		classifyPointsScalar(x + i, y + i, z + i, n - i, plane, eps, sides + i);
+	}
+
+	CSGHPP_TARGET_AVX2
+	CSGHPP_INLINE void classifyPointsAVX2(const float* x, const float* y, const float* z, unsigned n,
+		const PlaneT<float>& plane, float eps, unsigned char* sides)
+	{
+		__m256 nx = _mm256_set1_ps(plane.normal.x);
+		__m256 ny = _mm256_set1_ps(plane.normal.y);
+		__m256 nz = _mm256_set1_ps(plane.normal.z);
+		__m256 w = _mm256_set1_ps(plane.w);
+		__m256 pos_eps = _mm256_set1_ps(eps);
+		__m256 neg_eps = _mm256_set1_ps(-eps);
+		const unsigned* table = sideBytesTable();
+		unsigned i = 0;
+		for (; i + 8 <= n; i += 8)
+		{
+			__m256 t = _mm256_add_ps(_mm256_mul_ps(nx, _mm256_loadu_ps(x + i)), _mm256_mul_ps(ny, _mm256_loadu_ps(y + i)));
+			t = _mm256_sub_ps(_mm256_add_ps(t, _mm256_mul_ps(nz, _mm256_loadu_ps(z + i))), w);
+			int front = _mm256_movemask_ps(_mm256_cmp_ps(t, pos_eps, _CMP_GT_OQ));
+			int back = _mm256_movemask_ps(_mm256_cmp_ps(t, neg_eps, _CMP_LT_OQ));
+			memcpy(sides + i, &table[(front & 15) | ((back & 15) << 4)], 4);
+			memcpy(sides + i + 4, &table[(front >> 4) | ((back >> 4) << 4)], 4);
+		}
+		classifyPointsSSE(x + i, y + i, z + i, n - i, plane, eps, sides + i);
+	}
+
+	CSGHPP_INLINE bool cpuHasAVX2()
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) return false;
+		__cpuid(info, 1);
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) return false;
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+#endif
+
+	// Pick the fastest kernel the CPU supports, once.
+	CSGHPP_INLINE ClassifyPointsFn selectClassifyPoints()
+	{
+#ifdef CSGHPP_SIMD_X86
+		return cpuHasAVX2() ? classifyPointsAVX2 : classifyPointsSSE;
+#else
+		return classifyPointsScalar<float>;
+#endif
+	}
+
+	CSGHPP_INLINE void classifyPoints(const float* x, const float* y, const float* z, unsigned n,
+		const PlaneT<float>& plane, float eps, unsigned char* sides)
+	{
+		static const ClassifyPointsFn kernel = selectClassifyPoints();
+		kernel(x, y, z, n, plane, eps, sides);
+	}
+#endif
+
+	template<typename real>
+	struct ClassifyScratch
+	{
+		// Per thread buffers for splitPolygons, so classifying does not allocate
+		// once they have grown.
+		static ClassifyScratch& get()
+		{
+			static thread_local ClassifyScratch scratch;
+			return scratch;
+		}
+
+		void reserve(size_t n)
+		{
+			if (sides.size() >= n) return;
+			x.resize(n);
+			y.resize(n);
+			z.resize(n);
+			sides.resize(n);
+		}
+
+		std::vector<real> x, y, z;
+		std::vector<unsigned char> sides;
+		std::vector<unsigned char> sidesLow; // second pass of ExactPlanePrecision
+	};
+
+	// Precision policies for splitPolygons. classify() writes the sides of
+	// the first 'n' points in 'scratch' to scratch.sides, splitVertex() adds
+	// the vertex where the edge from vertex 'a' to 'b' crosses 'plane'.
+
+	struct FloatPrecision
+	{
+		// Arithmetic in the scalar type itself, so with double coordinates
+		// this is the same as DoublePrecision
+		template<typename real>
+		static void classify(ClassifyScratch<real>& scratch, unsigned n, const PlaneT<real>& plane, real eps)
+		{
+			classifyPoints(scratch.x.data(), scratch.y.data(), scratch.z.data(), n, plane, eps, scratch.sides.data());
+		}
+
+		template<typename real>
+		static unsigned splitVertex(const PlaneT<real>& plane, VertexPoolT<real>& pool, unsigned a, unsigned b)
+		{
+			const tvec3<real>& pa = pool.pos(a);
+			const tvec3<real>& pb = pool.pos(b);
+			real t = (plane.w - dot(plane.normal, pa)) / dot(plane.normal, pb - pa);
+			return pool.addOnEdge(a, b, t, lerp(pa, pb, t));
+		}
+	};
+
+	struct DoublePrecision
+	{
+		template<typename real>
+		static double distance(const PlaneT<real>& plane, double x, double y, double z)
+		{
+			return plane.normal.x * x + plane.normal.y * y + plane.normal.z * z - (double)plane.w;
+		}
+
+		template<typename real>
+		static void classify(ClassifyScratch<real>& scratch, unsigned n, const PlaneT<real>& plane, real eps)
+		{
+			for (unsigned i = 0; i < n; i++)
+			{
+				double t = distance(plane, scratch.x[i], scratch.y[i], scratch.z[i]);
+				scratch.sides[i] = (unsigned char)((t < -eps) ? BACK : ((t > eps) ? FRONT : COPLANAR));
+			}
+		}
+
+		template<typename real>
+		static unsigned splitVertex(const PlaneT<real>& plane, VertexPoolT<real>& pool, unsigned a, unsigned b)
+		{
+			const tvec3<real>& pa = pool.pos(a);
+			const tvec3<real>& pb = pool.pos(b);
+			double da = distance(plane, pa.x, pa.y, pa.z);
+			double db = distance(plane, pb.x, pb.y, pb.z);
+			double t = da / (da - db);
+			tvec3<real> p(
+				(real)(pa.x + (double(pb.x) - pa.x) * t),
+				(real)(pa.y + (double(pb.y) - pa.y) * t),
+				(real)(pa.z + (double(pb.z) - pa.z) * t));
+			return pool.addOnEdge(a, b, (real)t, p);
+		}
+	};
+
+	struct ExactPlanePrecision
+	{
+		// Sides as if the distances to the plane, as stored in 'real', were
+		// computed without rounding. The usual kernel runs with the tolerance
+		// widened and narrowed by a bound on its rounding error; where both
+		// agree that is the exact answer, the few points in between are
+		// classified with expansion arithmetic.
+		// This is exact against the stored plane only: the plane was rounded
+		// when it was computed from its polygon, and split fragments keep the
+		// plane of the polygon they came from, so the result is not that of an
+		// orientation test on the points that defined the plane. What it
+		// gives is consistency: the same point and plane always get the same
+		// side, whatever the order of the terms or the SIMD kernel.
+		// The split vertex itself cannot be exact and is made in double.
+
+		// Sign of the exact sum of 'n' doubles. Shewchuk's grow-expansion
+		// keeps the sum as non-overlapping components of increasing magnitude,
+		// so the sign is that of the last non-zero component.
+		static int sumSign(const double* terms, int n)
+		{
+			double e[8];
+			int m = 0;
+			for (int k = 0; k < n; k++)
+			{
+				double q = terms[k];
+				for (int i = 0; i < m; i++)
+				{
+					double sum = q + e[i];
+					double bv = sum - q;
+					e[i] = (q - (sum - bv)) + (e[i] - bv);
+					q = sum;
+				}
+				e[m++] = q;
+			}
+			for (int i = m - 1; i >= 0; i--)
+			{
+				if (e[i] != 0.0) return e[i] > 0.0 ? 1 : -1;
+			}
+			return 0;
+		}
+
+		// a * b as the exact sum of two doubles. The product of two floats
+		// fits a double, for doubles fma() gives the rounding error.
+		template<typename real>
+		static void product(real a, real b, double* terms)
+		{
+			terms[0] = double(a) * double(b);
+			terms[1] = sizeof(real) < sizeof(double) ? 0.0 : std::fma(double(a), double(b), -terms[0]);
+		}
+
+		template<typename real>
+		static unsigned char exactSide(const PlaneT<real>& plane, real x, real y, real z, real eps)
+		{
+			double terms[8];
+			product(plane.normal.x, x, terms);
+			product(plane.normal.y, y, terms + 2);
+			product(plane.normal.z, z, terms + 4);
+			terms[6] = -double(plane.w);
+			terms[7] = -double(eps);
+			if (sumSign(terms, 8) > 0) return FRONT;
+			terms[7] = eps;
+			if (sumSign(terms, 8) < 0) return BACK;
+			return COPLANAR;
+		}
+
+		template<typename real>
+		static void classify(ClassifyScratch<real>& scratch, unsigned n, const PlaneT<real>& plane, real eps)
+		{
+			real m = 0.f;
+			for (unsigned i = 0; i < n; i++)
+			{
+				m = std::max(m, std::max(std::abs(scratch.x[i]), std::max(std::abs(scratch.y[i]), std::abs(scratch.z[i]))));
+			}
+			// Three products and three sums, each off by at most half an ulp,
+			// with a generous safety factor
+			real terms = (std::abs(plane.normal.x) + std::abs(plane.normal.y) + std::abs(plane.normal.z)) * m + std::abs(plane.w);
+			real bound = 8 * std::numeric_limits<real>::epsilon() * terms;
+
+			scratch.sidesLow.resize(scratch.sides.size());
+			unsigned char* high = scratch.sides.data();
+			unsigned char* low = scratch.sidesLow.data();
+			classifyPoints(scratch.x.data(), scratch.y.data(), scratch.z.data(), n, plane, eps + bound, high);
+			bool certainCoplanar = eps > bound;
+			if (certainCoplanar)
+			{
+				classifyPoints(scratch.x.data(), scratch.y.data(), scratch.z.data(), n, plane, eps - bound, low);
+			}
+			for (unsigned i = 0; i < n; i++)
+			{
+				// FRONT or BACK beyond the widened tolerance is certain, and so
+				// is COPLANAR within the narrowed one
+				if (high[i] != COPLANAR || (certainCoplanar && low[i] == COPLANAR)) continue;
+				high[i] = exactSide(plane, scratch.x[i], scratch.y[i], scratch.z[i], eps);
+			}
+		}
+
+		template<typename real>
+		static unsigned splitVertex(const PlaneT<real>& plane, VertexPoolT<real>& pool, unsigned a, unsigned b)
+		{
+			return DoublePrecision::splitVertex(plane, pool, a, b);
+		}
+	};
+
+// Split 'polygon' given the class of each of its vertices in 'types' and their
+// union in 'polygonType'.
+// 'polygon' is moved into the output lists when it is not split, so pass an
+// rvalue when the input is no longer needed. Returns the class of 'polygon'.
+// 'Precision' makes the split vertices, see FloatPrecision.
+template<typename Precision = FloatPrecision, typename real, typename PolygonRef>
+unsigned splitPolygon(
+	const PlaneT<real>& plane, // The splitting plane
+	PolygonRef&& polygon,
+	VertexPoolT<real>& pool, // Holds the vertices of 'polygon', receives new split vertices
+	const unsigned char* types,
+	unsigned polygonType,
+	std::vector< PolygonT<real> >& coplanarFront,
+	std::vector< PolygonT<real> >& coplanarBack,
+	std::vector< PolygonT<real> >& front_polys,
+	std::vector< PolygonT<real> >& back_polys)
+{
+	bool isInFront = false;
+	// Put the polygon in the correct list, splitting it when necessary.
+	switch (polygonType) {
+	case COPLANAR:
+		isInFront = (plane.normal.dot(polygon.plane.normal) > 0);
+		(isInFront ? coplanarFront : coplanarBack).push_back(std::forward<PolygonRef>(polygon));
+		break;
+	case FRONT:
+		front_polys.push_back(std::forward<PolygonRef>(polygon));
+		break;
+	case BACK:
+		back_polys.push_back(std::forward<PolygonRef>(polygon));
+		break;
+	case SPANNING:
+		IndexList fverts;
+		IndexList bverts;
+		for (unsigned i = 0; i < polygon.vertices.size(); i++) 
+		{
+			unsigned j = (i + 1) % polygon.vertices.size();
+			unsigned ti = types[i];
+			unsigned tj = types[j];
+			unsigned vi = polygon.vertices[i];
+			unsigned vj = polygon.vertices[j];
+			if (ti != BACK) fverts.push_back(vi);
+			if (ti != FRONT) bverts.push_back(vi);
+			if ((ti | tj) == SPANNING) {
+				// pool segments never move, so these stay valid across add()
+				unsigned v = Precision::splitVertex(plane, pool, vi, vj);
+				fverts.push_back(v);
+				bverts.push_back(v);
+			}
+		}
+		unsigned lineage = polygon.lineage ? polygon.lineage : PolygonT<real>::newLineage();
+		if (fverts.size() >= 3) front_polys.push_back( PolygonT<real>(std::move(fverts), polygon, lineage));
+		if (bverts.size() >= 3) back_polys.push_back( PolygonT<real>(std::move(bverts), polygon, lineage));
+		break;
+	}
+	return polygonType;
+}
+
+// As above, classifying the vertices first.
+template<typename real, typename PolygonRef>
+unsigned splitPolygon(
+	const PlaneT<real>& plane, // The splitting plane
+	PolygonRef&& polygon,
+	VertexPoolT<real>& pool, // Holds the vertices of 'polygon', receives new split vertices
+	std::vector< PolygonT<real> >& coplanarFront,
+	std::vector< PolygonT<real> >& coplanarBack,
+	std::vector< PolygonT<real> >& front_polys,
+	std::vector< PolygonT<real> >& back_polys,
+	typename NonDeduced<real>::type eps = defaultEpsilon<real>())
+{
+	// Classify each point as well as the entire polygon into one of the above
+	// four classes.
+	unsigned char local[64];
+	std::vector<unsigned char> large;
+	unsigned char* types = local;
+	if (polygon.vertices.size() > sizeof(local))
+	{
+		large.resize(polygon.vertices.size());
+		types = large.data();
+	}
+	unsigned polygonType = 0;
+	for (size_t i = 0; i < polygon.vertices.size(); i++)
+	{
+		real t = dot(plane.normal, pool.pos(polygon.vertices[i])) - plane.w;
+		types[i] = (unsigned char)((t < -eps) ? BACK : ((t > eps) ? FRONT : COPLANAR));
+		polygonType |= types[i];
+	}
+	return splitPolygon(plane, std::forward<PolygonRef>(polygon), pool, types, polygonType,
+		coplanarFront, coplanarBack, front_polys, back_polys);
+}
+
+// Split 'count' polygons starting at 'polys', which are moved from.
+// The vertices are gathered into arrays of x, y and z in blocks, classified
+// according to 'Precision', and then the polygons are split.
+// Returns the number of polygons that were split.
+template<typename Precision, typename real>
+unsigned splitPolygonsWith(
+	const PlaneT<real>& plane,
+	PolygonT<real>* polys,
+	size_t count,
+	VertexPoolT<real>& pool,
+	std::vector< PolygonT<real> >& coplanarFront,
+	std::vector< PolygonT<real> >& coplanarBack,
+	std::vector< PolygonT<real> >& front_polys,
+	std::vector< PolygonT<real> >& back_polys,
+	real eps)
+{
+	const unsigned BLOCK = 1024; // vertices classified at once
+	ClassifyScratch<real>& scratch = ClassifyScratch<real>::get();
+	unsigned spans = 0;
+	size_t begin = 0;
+	while (begin < count)
+	{
+		size_t end = begin;
+		unsigned n = 0;
+		while (end < count && (n == 0 || n + polys[end].vertices.size() <= BLOCK))
+		{
+			n += (unsigned)polys[end].vertices.size();
+			end++;
+		}
+		scratch.reserve(n);
+
+		unsigned k = 0;
+		for (size_t i = begin; i < end; i++)
+		{
+			for (unsigned vi : polys[i].vertices)
+			{
+				const tvec3<real>& p = pool.pos(vi);
+				scratch.x[k] = p.x;
+				scratch.y[k] = p.y;
+				scratch.z[k] = p.z;
+				k++;
+			}
+		}
+		Precision::classify(scratch, n, plane, eps);
+
+		const unsigned char* sides = scratch.sides.data();
+		for (size_t i = begin; i < end; i++)
+		{
+			size_t nv = polys[i].vertices.size();
+			unsigned polygonType = 0;
+			for (size_t v = 0; v < nv; v++) polygonType |= sides[v];
+			spans += splitPolygon<Precision>(plane, std::move(polys[i]), pool, sides, polygonType,
+				coplanarFront, coplanarBack, front_polys, back_polys) == SPANNING;
+			sides += nv;
+		}
+		begin = end;
+	}
+	return spans;
+}
+
+// As above, with the precision and tolerance chosen at run time
+template<typename real>
+unsigned splitPolygons(
+	const PlaneT<real>& plane,
+	PolygonT<real>* polys,
+	size_t count,
+	VertexPoolT<real>& pool,
+	std::vector< PolygonT<real> >& coplanarFront,
+	std::vector< PolygonT<real> >& coplanarBack,
+	std::vector< PolygonT<real> >& front_polys,
+	std::vector< PolygonT<real> >& back_polys,
+	ePrecision precision = PRECISION_FLOAT,
+	typename NonDeduced<real>::type eps = defaultEpsilon<real>())
+{
+	switch (precision)
+	{
+	case PRECISION_DOUBLE:
+		return splitPolygonsWith<DoublePrecision>(plane, polys, count, pool, coplanarFront, coplanarBack, front_polys, back_polys, eps);
+	case PRECISION_EXACT_PLANE:
+		return splitPolygonsWith<ExactPlanePrecision>(plane, polys, count, pool, coplanarFront, coplanarBack, front_polys, back_polys, eps);
+	default:
+		return splitPolygonsWith<FloatPrecision>(plane, polys, count, pool, coplanarFront, coplanarBack, front_polys, back_polys, eps);
+	}
+}
+
+	// Child index meaning "no child".
+	static const unsigned NO_NODE = ~0u;
+
+	template<typename real>
+	struct BSPNodeT
+	{
+		typedef PlaneT<real> Plane;
+		typedef PolygonT<real> Polygon;
+
+		// One node of a BSP tree, stored in a NodeArena.
+		// 'front' and 'back' are indices into the same arena.
+		BSPNodeT()
+			: plane()
+			, front(NO_NODE)
+			, back(NO_NODE)
+			, entered(0)
+			, spans(0)
+			, height(0)
+		{
+		}
+
+		Plane plane;
+		unsigned front;
+		unsigned back;
+		std::vector< Polygon > polygons;
+		// For Node::rebalance(): polygons pushed into the subtree and polygons
+		// split at this node since the subtree was built, and the height of
+		// the subtree right after it was built (0 if not known yet).
+		unsigned entered;
+		unsigned spans;
+		unsigned height;
+	};
+
+	template<typename real>
+	struct NodeArenaT
+	{
+		typedef PlaneT<real> Plane;
+		typedef BSPNodeT<real> BSPNode;
+
+		// Pool of BSP nodes. Any number of trees can live in one arena, and all
+		// of them are released at once with reset(). Released nodes are kept
+		// around so their polygon lists can reuse their capacity.
+		// Nodes never move and alloc() is thread safe, so subtrees can be built
+		// in parallel.
+		NodeArenaT()
+			: hasReleased(false)
+		{
+		}
+
+		unsigned alloc()
+		{
+			unsigned i;
+			if (!reuse(i)) i = nodes.grow();
+			BSPNode& n = nodes[i];
+			n.plane = Plane();
+			n.front = NO_NODE;
+			n.back = NO_NODE;
+			n.polygons.clear();
+			n.entered = 0;
+			n.spans = 0;
+			n.height = 0;
+			return i;
+		}
+
+		// Hand node 'i' back, for alloc() to return it again. Used when a
+		// subtree is rebuilt, so that editing a tree does not grow the arena.
+		void release(unsigned i)
+		{
+			std::lock_guard<std::mutex> guard(releasedLock);
+			released.push_back(i);
+			hasReleased = true;
+		}
+
+		void reset()
+		{
+			for (unsigned i = 0; i < nodes.size(); i++)
+			{
+				nodes[i].polygons.clear();
+			}
+			nodes.rewind();
+			released.clear();
+			hasReleased = false;
+		}
+
+		unsigned size() const { return nodes.size(); }
+
+		BSPNode& operator[](unsigned i) { return nodes[i]; }
+		const BSPNode& operator[](unsigned i) const { return nodes[i]; }
+
+		bool reuse(unsigned& i)
+		{
+			if (!hasReleased.load(std::memory_order_relaxed)) return false;
+			std::lock_guard<std::mutex> guard(releasedLock);
+			if (released.empty()) return false;
+			i = released.back();
+			released.pop_back();
+			hasReleased = !released.empty();
+			return true;
+		}
+
+		SegmentedArray<BSPNode> nodes;
+		std::vector<unsigned> released;
+		std::atomic<bool> hasReleased;
+		std::mutex releasedLock;
+	};
+
+	// How Node::build picks the plane to split a node's polygons with
+	enum eSplitter {
+		SPLIT_FIRST,        // plane of the first polygon, as csg.js does
+		SPLIT_RANDOM,       // plane of a random polygon
+		SPLIT_COST,         // candidate plane with the fewest splits and best balance
+		SPLIT_AXIS_ALIGNED, // as SPLIT_COST, with axis aligned planes preferred
+	};
+
+	template<typename real>
+	struct OptionsT
+	{
+		// Settings for the BSP passes of the boolean operations, for CSGs of
+		// the same scalar type. Options go with CSG, Optionsd with CSGd.
+		OptionsT()
+			: threads(nullptr)
+			, parallelCutoff(256)
+			, splitter(SPLIT_FIRST)
+			, splitterCandidates(8)
+			, splitterSamples(64)
+			, splitCost(8.f)
+			, axisAlignedCost(0.5f)
+			, seed(1)
+			, precision(PRECISION_FLOAT)
+			, epsilon(defaultEpsilon<real>())
+			, stats(nullptr)
+			, rebalanceDepthGrowth(0.f)
+			, rebalanceSplitRatio(0.f)
+			, mergeFragments(false)
+		{
+		}
+
+		// The options used when none are passed explicitly
+		static OptionsT& defaults()
+		{
+			static OptionsT options;
+			return options;
+		}
+
+		// Thread pool to run the BSP passes on, nullptr runs them on the calling
+		// thread. ThreadPool::shared() uses all hardware threads.
+		ThreadPool* threads;
+		// Subtrees built from fewer polygons than this are built serially
+		size_t parallelCutoff;
+
+		eSplitter splitter;
+		// Number of candidate planes tried per node by SPLIT_COST and SPLIT_AXIS_ALIGNED
+		unsigned splitterCandidates;
+		// Number of polygons each candidate is tested against
+		unsigned splitterSamples;
+		// Cost of one split polygon, relative to one polygon of front/back imbalance
+		real splitCost;
+		// Cost factor for axis aligned candidates with SPLIT_AXIS_ALIGNED
+		real axisAlignedCost;
+		// Seed for the random choices, which are also deterministic per polygon list
+		unsigned seed;
+		// Arithmetic of the plane tests and splits. PRECISION_EXACT_PLANE makes
+		// the classification against each stored plane independent of
+		// rounding, at some cost on large models.
+		ePrecision precision;
+		// Distance within which points count as on a plane. Scale it with the
+		// model: it should be well below its smallest features.
+		real epsilon;
+		// If set, boolean operations add the stats of their BSP trees here
+		struct BuildStats* stats;
+		// Limits for Node::rebalance(), 0 disables them. A subtree is rebuilt
+		// once it is more than 'rebalanceDepthGrowth' times as deep as when it
+		// was built, or once more than 'rebalanceSplitRatio' times as many
+		// polygons were split in it as were pushed into it.
+		real rebalanceDepthGrowth;
+		real rebalanceSplitRatio;
+		// Merge the fragments of split polygons back together after each
+		// boolean operation where they still meet, see CSG::mergeFragments()
+		bool mergeFragments;
+	};
+
+	struct BuildStats
+	{
+		// Shape of a BSP tree, see Node::buildStats()
+		BuildStats()
+			: nodes(0)
+			, depth(0)
+			, polygons(0)
+			, splits(0)
+		{
+		}
+
+		BuildStats& operator+=(const BuildStats& o)
+		{
+			nodes += o.nodes;
+			depth = std::max(depth, o.depth);
+			polygons += o.polygons;
+			splits += o.splits;
+			return *this;
+		}
+
+		unsigned nodes;
+		unsigned depth;    // nodes on the longest path from the root
+		unsigned polygons; // polygons stored in the nodes
+		unsigned splits;   // polygons split while building
+	};
+
+	template<typename real>
+	struct NodeT
+	{
+		typedef OptionsT<real> Options;
+		typedef tvec3<real> vec3;
+		typedef PlaneT<real> Plane;
+		typedef PolygonT<real> Polygon;
+		typedef VertexPoolT<real> VertexPool;
+		typedef AABBT<real> AABB;
+		typedef BSPNodeT<real> BSPNode;
+		typedef NodeArenaT<real> NodeArena;
+
+		// Holds a BSP tree.
+		// A BSP tree is built from a collection of polygons
+		// by picking a polygon to split along. 
+		// That polygon (and all other coplanar polygons) are added directly to that node
+		// and the other polygons are added to the front and/or back subtrees.
+		// This is not a leafy BPS tree since there is no distinction
+		// between internal and leaf nodes.
+		// The nodes live in a NodeArena, either owned by the tree or shared with
+		// other trees (see CSG::scratchArena). The polygons index into 'pool',
+		// which also receives the vertices created when polygons are split.
+		NodeT(VertexPool& _pool, const Options& _options = Options::defaults())
+			: ownedArena(new NodeArena)
+			, arena(ownedArena.get())
+			, pool(&_pool)
+			, root(arena->alloc())
+			, options(_options)
+			, splits(0)
+			, inverted(false)
+		{
+		}
+
+		NodeT(VertexPool& _pool, std::vector<Polygon> in_polygons, const Options& _options = Options::defaults())
+			: ownedArena(new NodeArena)
+			, arena(ownedArena.get())
+			, pool(&_pool)
+			, root(arena->alloc())
+			, options(_options)
+			, splits(0)
+			, inverted(false)
+		{
+			build(std::move(in_polygons));
+		}
+
+		NodeT(NodeArena& _arena, VertexPool& _pool, std::vector<Polygon> in_polygons, const Options& _options = Options::defaults())
+			: ownedArena()
+			, arena(&_arena)
+			, pool(&_pool)
+			, root(arena->alloc())
+			, options(_options)
+			, splits(0)
+			, inverted(false)
+		{
+			build(std::move(in_polygons));
+		}
+
+		// Copy of the tree 'o' in an arena of its own, with polygons indexing
+		// into '_pool', which must hold the vertices of o's pool.
+		// Copying a tree is much cheaper than building it again.
+		NodeT(const NodeT& o, VertexPool& _pool);
+
+		// Convert solid space to empty space and empty space to solid space.
+		void invert()
+		{
+			std::vector<unsigned> nodes;
+			nodes.push_back(root);
+			while (nodes.empty() == false)
+			{
+				BSPNode& n = (*arena)[nodes.back()];
+				nodes.pop_back();
+				std::for_each(n.polygons.begin(), n.polygons.end(), [](Polygon& p) { p.flip(); });
+				n.plane.flip();
+				if (n.front != NO_NODE) nodes.push_back(n.front);
+				if (n.back != NO_NODE) nodes.push_back(n.back);
+				std::swap(n.front, n.back);
+			}
+			inverted = !inverted;
+		}
+
+		// Put all a copy of all polygons in 'b' into 'a'
+		static void concat(std::vector<Polygon>& a, const std::vector<Polygon>& b)
+		{
+			a.insert(a.end(), b.begin(), b.end());
+		}
+
+		// Move all polygons in 'b' into 'a', leaving 'b' empty
+		static void concat(std::vector<Polygon>& a, std::vector<Polygon>&& b)
+		{
+			if (a.empty())
+			{
+				a.swap(b);
+			}
+			else
+			{
+				a.insert(a.end(), std::make_move_iterator(b.begin()), std::make_move_iterator(b.end()));
+			}
+			b.clear();
+		}
+
+		// A node together with the polygons still to be pushed through it
+		struct WorkItem
+		{
+			WorkItem(unsigned _node, std::vector<Polygon>&& _polygons)
+				: node(_node)
+				, polygons(std::move(_polygons))
+			{
+			}
+			unsigned node;
+			std::vector<Polygon> polygons;
+		};
+
+		// Split all of 'list' by 'plane' like splitPolygon does, consuming 'list'.
+		// Large lists are cut into chunks that are split in parallel. The outputs
+		// are joined in chunk order, so they come out as if split serially.
+		// Returns the number of polygons that were split.
+		unsigned splitList(const Plane& plane, std::vector<Polygon>& list, VertexPool& listPool,
+			std::vector<Polygon>& coplanarFront,
+			std::vector<Polygon>& coplanarBack,
+			std::vector<Polygon>& front_polys,
+			std::vector<Polygon>& back_polys) const;
+
+		// Remove all polys in 'polygons' that are inside this tree
+		std::vector<Polygon> clipPolygons(const std::vector<Polygon>& input) const
+		{
+			return clipPolygons(std::vector<Polygon>(input), *pool);
+		}
+
+		// As above, for polygons whose vertices are in 'inputPool'.
+		// 'input' is consumed.
+		std::vector<Polygon> clipPolygons(std::vector<Polygon>&& input, VertexPool& inputPool) const
+		{
+			if (options.threads && input.size() >= options.parallelCutoff)
+			{
+				return clipParallel(root, std::move(input), inputPool);
+			}
+			return clipSerial(root, std::move(input), inputPool);
+		}
+
+		std::vector<Polygon> clipSerial(unsigned start, std::vector<Polygon>&& input, VertexPool& inputPool) const;
+
+		// Same result, in the same order, as clipSerial: polygons kept at node
+		// 'ni', then those kept by its back subtree, then by its front subtree.
+		// Large lists are split in parallel and large subtrees become tasks.
+		std::vector<Polygon> clipParallel(unsigned ni, std::vector<Polygon>&& list, VertexPool& inputPool) const;
+
+		// Remove all polygons in this BSP tree that are inside the other BSP tree 'bsp'
+		void clipTo(const NodeT& bsp);
+
+		// Return a list of all polys in this BSP tree.
+		std::vector<Polygon> allPolygons() const
+		{
+			std::vector<Polygon> sum;
+			std::vector<unsigned> nodes;
+			nodes.push_back(root);
+			for (size_t head = 0; head < nodes.size(); head++)
+			{
+				const BSPNode& n = (*arena)[nodes[head]];
+				concat(sum, n.polygons);
+				if (n.front != NO_NODE) nodes.push_back(n.front);
+				if (n.back != NO_NODE) nodes.push_back(n.back);
+			}
+			return sum;
+		}
+
+		// Move all polys out of this BSP tree, leaving the nodes empty.
+		std::vector<Polygon> takeAllPolygons()
+		{
+			std::vector<Polygon> sum;
+			std::vector<unsigned> nodes;
+			nodes.push_back(root);
+			for (size_t head = 0; head < nodes.size(); head++)
+			{
+				BSPNode& n = (*arena)[nodes[head]];
+				concat(sum, std::move(n.polygons));
+				if (n.front != NO_NODE) nodes.push_back(n.front);
+				if (n.back != NO_NODE) nodes.push_back(n.back);
+			}
+			return sum;
+		}
+
+		// Build a BSP tree out of 'polygons' polygons
+		void build(const std::vector<Polygon>& input)
+		{
+			build(std::vector<Polygon>(input));
+		}
+
+		// As above, consuming 'input'
+		void build(std::vector<Polygon>&& input);
+
+		// Incremental editing, for changes too small to rebuild the tree for.
+		// insert() adds polygons like build(), keeping the existing nodes, then
+		// rebalances. remove() takes out the polygons tagged 'shared' (see
+		// Polygon::shared, which split fragments inherit) and returns how many
+		// it removed. Both keep the tree a BSP tree of its remaining polygons.
+		void insert(std::vector<Polygon>&& input);
+		unsigned remove(unsigned shared);
+
+		// Rebuild the subtrees that grew past the limits in 'options' (see
+		// Options::rebalanceDepthGrowth), topmost first. Returns the number of
+		// subtrees rebuilt.
+		unsigned rebalance();
+
+		// Build the subtree at node 'ni' again from its polygons, leaving out
+		// those for which drop(polygon) is true
+		template<typename F>
+		void rebuildSubtree(unsigned ni, F drop);
+
+		// Build 'input' into the subtree at node 'ni'
+		void buildAt(unsigned ni, std::vector<Polygon>&& input);
+
+		static unsigned nextRandom(unsigned& state)
+		{
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			return state;
+		}
+
+		static bool isAxisAligned(vec3 n)
+		{
+			return std::max(fabs(n.x), std::max(fabs(n.y), fabs(n.z))) > 1.f - 1e-5f;
+		}
+
+		// Pick the plane to split 'list' with, according to options.splitter.
+		// The plane is always that of a polygon in 'list', so the node keeps
+		// at least that polygon and the recursion ends.
+		Plane chooseSplitter(const std::vector<Polygon>& list) const;
+
+		// Return the size and shape of the tree
+		BuildStats buildStats() const;
+
+		// True if every solid leaf of the tree lies right behind a polygon of
+		// its parent node. The boolean operations only put the polygons of
+		// the other operand that survive clipping into the tree, so a solid
+		// cell that the other operand removes entirely is still classified as
+		// solid: the polygons taken from such a tree are right, but the tree
+		// itself no longer describes the result and must not be used to clip.
+		// A solid leaf behind a remaining polygon cannot have been removed
+		// entirely, so a tree passing this test describes its polygons.
+		bool solidLeavesBounded() const;
+
+		// Call f(Polygon&) for all polygons in the tree
+		template<typename F>
+		void forEachPolygon(F f)
+		{
+			std::vector<unsigned> nodes;
+			nodes.push_back(root);
+			while (nodes.empty() == false)
+			{
+				BSPNode& n = (*arena)[nodes.back()];
+				nodes.pop_back();
+				std::for_each(n.polygons.begin(), n.polygons.end(), f);
+				if (n.front != NO_NODE) nodes.push_back(n.front);
+				if (n.back != NO_NODE) nodes.push_back(n.back);
+			}
+		}
+
+		// Split 'list' by the plane of node 'ni', keeping the coplanar polygons
+		// in the node. Returns the child nodes that get 'pfront' and 'pback',
+		// allocating them when needed, or NO_NODE for an empty list.
+		void buildNode(unsigned ni, std::vector<Polygon>& list,
+			std::vector<Polygon>& pfront, unsigned& front,
+			std::vector<Polygon>& pback, unsigned& back);
+
+		void buildSerial(unsigned start, std::vector<Polygon>&& input);
+
+		// The front and back subtrees of a node are independent once its
+		// polygons are partitioned, so large ones become tasks of 'group'.
+		void buildParallel(TaskGroup& group, unsigned ni, std::vector<Polygon>&& list);
+
+		std::unique_ptr<NodeArena> ownedArena;
+		NodeArena* arena;
+		VertexPool* pool;
+		unsigned root;
+		Options options;
+		std::atomic<unsigned> splits; // polygons split by build()
+		AABB bounds;   // of all polygons the tree was built from
+		bool inverted; // the tree classifies the outside of its polygons as solid
+	};
+
+#if CSGHPP_DEFINE_KERNELS
+	template<typename real>
+	CSGHPP_INLINE NodeT<real>::NodeT(const NodeT& o, VertexPool& _pool)
+		: ownedArena(new NodeArena)
+		, arena(ownedArena.get())
+		, pool(&_pool)
+		, root(arena->alloc())
+		, options(o.options)
+		, splits(o.splits.load())
+		, bounds(o.bounds)
+		, inverted(o.inverted)
+	{
+		std::vector< std::pair<unsigned, unsigned> > nodes; // ours, theirs
+		nodes.push_back(std::make_pair(root, o.root));
+		while (nodes.empty() == false)
+		{
+			BSPNode& n = (*arena)[nodes.back().first];
+			const BSPNode& src = (*o.arena)[nodes.back().second];
+			nodes.pop_back();
+			n.plane = src.plane;
+			n.polygons = src.polygons;
+			n.entered = src.entered;
+			n.spans = src.spans;
+			n.height = src.height;
+			if (src.front != NO_NODE)
+			{
+				n.front = arena->alloc();
+				nodes.push_back(std::make_pair(n.front, src.front));
+			}
+			if (src.back != NO_NODE)
+			{
+				n.back = arena->alloc();
+				nodes.push_back(std::make_pair(n.back, src.back));
+			}
+		}
+	}
+
+	template<typename real>
+	CSGHPP_INLINE unsigned NodeT<real>::splitList(const Plane& plane, std::vector<Polygon>& list, VertexPool& listPool,
+		std::vector<Polygon>& coplanarFront,
+		std::vector<Polygon>& coplanarBack,
+		std::vector<Polygon>& front_polys,
+		std::vector<Polygon>& back_polys) const
+	{
+		size_t chunkSize = std::max<size_t>(options.parallelCutoff, 1);
+		if (!options.threads || list.size() < 2 * chunkSize)
+		{
+			unsigned spans = splitPolygons(plane, list.data(), list.size(), listPool,
+				coplanarFront, coplanarBack, front_polys, back_polys, options.precision, options.epsilon);
+			list.clear();
+			return spans;
+		}
+
+		// Outputs that are the same list must be the same list within a chunk too
+		std::vector<Polygon>* targets[4] = { &coplanarFront, &coplanarBack, &front_polys, &back_polys };
+		int slot[4];
+		for (int i = 0; i < 4; i++)
+		{
+			slot[i] = i;
+			for (int j = 0; j < i; j++)
+			{
+				if (targets[j] == targets[i]) { slot[i] = slot[j]; break; }
+			}
+		}
+
+		struct Chunk
+		{
+			Chunk() : spans(0) {}
+			std::vector<Polygon> out[4];
+			unsigned spans;
+		};
+		size_t chunks = (list.size() + chunkSize - 1) / chunkSize;
+		std::vector<Chunk> parts(chunks);
+		TaskGroup group(*options.threads);
+		for (size_t c = 0; c < chunks; c++)
+		{
+			group.run([&, c]()
+			{
+				Chunk& part = parts[c];
+				size_t begin = c * chunkSize;
+				size_t end = std::min(list.size(), begin + chunkSize);
+				part.spans = splitPolygons(plane, list.data() + begin, end - begin, listPool,
+					part.out[slot[0]], part.out[slot[1]], part.out[slot[2]], part.out[slot[3]],
+					options.precision, options.epsilon);
+			});
+		}
+		group.wait();
+		unsigned spans = 0;
+		for (Chunk& part : parts)
+		{
+			for (int i = 0; i < 4; i++)
+			{
+				if (slot[i] == i) concat(*targets[i], std::move(part.out[i]));
+			}
+			spans += part.spans;
+		}
+		list.clear();
+		return spans;
+	}
+
+	template<typename real>
+	CSGHPP_INLINE auto NodeT<real>::clipSerial(unsigned start, std::vector<Polygon>&& input, VertexPool& inputPool) const -> std::vector<Polygon>
+	{
+		std::vector<Polygon> sum;
+		std::vector<WorkItem> work;
+		work.emplace_back(start, std::move(input));
+
+		while (work.empty() == false)
+		{
+			WorkItem item = std::move(work.back());
+			work.pop_back();
+			const BSPNode& n = (*arena)[item.node];
+			if ( !n.plane.ok() ) {
+				concat(sum, std::move(item.polygons));
+				continue;
+			}
+
+			std::vector<Polygon> pfront, pback;
+			splitPolygons(n.plane, item.polygons.data(), item.polygons.size(), inputPool, pfront, pback, pfront, pback,
+				options.precision, options.epsilon);
+			if (n.front != NO_NODE)
+			{
+				if (!pfront.empty()) work.emplace_back(n.front, std::move(pfront));
+			}
+			else {
+				concat(sum, std::move(pfront));
+			}
+
+			if (n.back != NO_NODE)
+			{
+				if (!pback.empty()) work.emplace_back(n.back, std::move(pback));
+			}
+		}
+		return sum;
+	}
+
+	template<typename real>
+	CSGHPP_INLINE auto NodeT<real>::clipParallel(unsigned ni, std::vector<Polygon>&& list, VertexPool& inputPool) const -> std::vector<Polygon>
+	{
+		const BSPNode& n = (*arena)[ni];
+		if (!n.plane.ok()) return std::move(list);
+
+		std::vector<Polygon> pfront, pback;
+		splitList(n.plane, list, inputPool, pfront, pback, pfront, pback);
+
+		std::vector<Polygon> sum, backSum, frontSum;
+		if (n.front == NO_NODE) sum = std::move(pfront);
+
+		unsigned children[2] = { n.back, n.front };
+		std::vector<Polygon>* lists[2] = { &pback, &pfront };
+		std::vector<Polygon>* results[2] = { &backSum, &frontSum };
+		bool spawn[2];
+		for (int i = 0; i < 2; i++)
+		{
+			spawn[i] = children[i] != NO_NODE && lists[i]->size() >= options.parallelCutoff;
+		}
+		TaskGroup group(*options.threads);
+		for (int i = 0; i < 2; i++)
+		{
+			if (!spawn[i]) continue;
+			group.run([this, &inputPool, i, &children, &lists, &results]()
+			{
+				*results[i] = clipParallel(children[i], std::move(*lists[i]), inputPool);
+			});
+		}
+		for (int i = 0; i < 2; i++)
+		{
+			if (spawn[i] || children[i] == NO_NODE || lists[i]->empty()) continue;
+			*results[i] = clipSerial(children[i], std::move(*lists[i]), inputPool);
+		}
+		group.wait();
+		concat(sum, std::move(backSum));
+		concat(sum, std::move(frontSum));
+		return sum;
+	}
+
+	template<typename real>
+	CSGHPP_INLINE void NodeT<real>::clipTo(const NodeT& bsp)
+	{
+		std::vector<unsigned> nodes;
+		nodes.push_back(root);
+		for (size_t head = 0; head < nodes.size(); head++)
+		{
+			const BSPNode& n = (*arena)[nodes[head]];
+			if (n.front != NO_NODE) nodes.push_back(n.front);
+			if (n.back != NO_NODE) nodes.push_back(n.back);
+		}
+
+		// The solid of 'bsp' lies within its bounds. Polygons outside them
+		// are outside that solid, so they are kept as they are, or dropped
+		// if 'bsp' is inverted, without going through the tree.
+		bool cull = !bsp.bounds.contains(bounds, options.epsilon);
+
+		// 'bsp' may share our arena, but clipping never allocates nodes,
+		// and every node's polygon list is only touched by one task
+		auto clipNodes = [this, &bsp, &nodes, cull](size_t begin, size_t end)
+		{
+			std::vector<Polygon> near;
+			for (size_t i = begin; i < end; i++)
+			{
+				BSPNode& n = (*arena)[nodes[i]];
+				if (!cull)
+				{
+					n.polygons = bsp.clipPolygons(std::move(n.polygons), *pool);
+					continue;
+				}
+				size_t kept = 0;
+				for (size_t k = 0; k < n.polygons.size(); k++)
+				{
+					Polygon& p = n.polygons[k];
+					if (p.bounds(*pool).overlaps(bsp.bounds, options.epsilon))
+					{
+						near.push_back(std::move(p));
+					}
+					else if (!bsp.inverted)
+					{
+						if (kept != k) n.polygons[kept] = std::move(p);
+						kept++;
+					}
+				}
+				n.polygons.resize(kept);
+				if (!near.empty())
+				{
+					concat(n.polygons, bsp.clipPolygons(std::move(near), *pool));
+					near.clear();
+				}
+			}
+		};
+
+		if (!options.threads)
+		{
+			clipNodes(0, nodes.size());
+			return;
+		}
+
+		// Hand out runs of nodes holding about 'parallelCutoff' polygons each
+		TaskGroup group(*options.threads);
+		size_t begin = 0;
+		size_t batch = 0;
+		for (size_t i = 0; i < nodes.size(); i++)
+		{
+			batch += (*arena)[nodes[i]].polygons.size();
+			if (batch >= options.parallelCutoff || i + 1 == nodes.size())
+			{
+				size_t end = i + 1;
+				group.run([&clipNodes, begin, end]() { clipNodes(begin, end); });
+				begin = end;
+				batch = 0;
+			}
+		}
+		group.wait();
+	}
+
+	template<typename real>
+	CSGHPP_INLINE void NodeT<real>::build(std::vector<Polygon>&& input)
+	{
+		if (input.empty()) return;
+
+		for (const Polygon& p : input)
+		{
+			bounds.add(p.bounds(*pool));
+		}
+
+		buildAt(root, std::move(input));
+	}
+
+	template<typename real>
+	CSGHPP_INLINE void NodeT<real>::buildAt(unsigned ni, std::vector<Polygon>&& input)
+	{
+		if (options.threads && input.size() >= options.parallelCutoff)
+		{
+			TaskGroup group(*options.threads);
+			buildParallel(group, ni, std::move(input));
+			group.wait();
+			return;
+		}
+		buildSerial(ni, std::move(input));
+	}
+
+	template<typename real>
+	CSGHPP_INLINE void NodeT<real>::insert(std::vector<Polygon>&& input)
+	{
+		// Record the height of a tree from build() before it grows
+		if ((*arena)[root].height == 0) rebalance();
+		build(std::move(input));
+		rebalance();
+	}
+
+	template<typename real>
+	CSGHPP_INLINE unsigned NodeT<real>::remove(unsigned shared)
+	{
+		auto tagged = [shared](const Polygon& p) { return p.shared == shared; };
+		unsigned removed = 0;
+		std::vector<unsigned> nodes;
+		nodes.push_back(root);
+		while (nodes.empty() == false)
+		{
+			unsigned ni = nodes.back();
+			nodes.pop_back();
+			BSPNode& n = (*arena)[ni];
+			size_t count = n.polygons.size();
+			auto end = std::remove_if(n.polygons.begin(), n.polygons.end(), tagged);
+			if (end == n.polygons.begin() && count > 0)
+			{
+				// The node's plane no longer bounds anything, and the cells
+				// below it depend on it, so build them again without it
+				std::vector<unsigned> below;
+				if (n.front != NO_NODE) below.push_back(n.front);
+				if (n.back != NO_NODE) below.push_back(n.back);
+				for (size_t head = 0; head < below.size(); head++)
+				{
+					const BSPNode& b = (*arena)[below[head]];
+					removed += (unsigned)std::count_if(b.polygons.begin(), b.polygons.end(), tagged);
+					if (b.front != NO_NODE) below.push_back(b.front);
+					if (b.back != NO_NODE) below.push_back(b.back);
+				}
+				removed += (unsigned)count;
+				rebuildSubtree(ni, tagged);
+				continue;
+			}
+			removed += (unsigned)(n.polygons.end() - end);
+			n.polygons.erase(end, n.polygons.end());
+			if (n.front != NO_NODE) nodes.push_back(n.front);
+			if (n.back != NO_NODE) nodes.push_back(n.back);
+		}
+		return removed;
+	}
+
+	template<typename real>
+	CSGHPP_INLINE unsigned NodeT<real>::rebalance()
+	{
+		// Heights and split counts of all subtrees, from the nodes in breadth
+		// first order, children after their parents
+		std::vector<unsigned> order, parent, height, spans;
+		order.push_back(root);
+		parent.push_back(NO_NODE);
+		for (size_t head = 0; head < order.size(); head++)
+		{
+			const BSPNode& n = (*arena)[order[head]];
+			for (unsigned child : { n.front, n.back })
+			{
+				if (child == NO_NODE) continue;
+				order.push_back(child);
+				parent.push_back((unsigned)head);
+			}
+		}
+		height.assign(order.size(), 1);
+		spans.resize(order.size());
+		for (size_t k = 0; k < order.size(); k++) spans[k] = (*arena)[order[k]].spans;
+		for (size_t k = order.size(); k-- > 1;)
+		{
+			height[parent[k]] = std::max(height[parent[k]], height[k] + 1);
+			spans[parent[k]] += spans[k];
+		}
+
+		// Small subtrees are cheap to clip through even when unbalanced
+		const unsigned minHeight = 8, minEntered = 64;
+		unsigned rebuilt = 0;
+		std::vector<bool> skip(order.size(), false);
+		for (size_t k = 0; k < order.size(); k++)
+		{
+			if (k > 0 && skip[parent[k]])
+			{
+				skip[k] = true;
+				continue;
+			}
+			BSPNode& n = (*arena)[order[k]];
+			if (n.height == 0) n.height = height[k];
+			bool deep = options.rebalanceDepthGrowth > 0.f && height[k] >= minHeight &&
+				height[k] > options.rebalanceDepthGrowth * n.height;
+			bool split = options.rebalanceSplitRatio > 0.f && n.entered >= minEntered &&
+				spans[k] > options.rebalanceSplitRatio * n.entered;
+			if (deep || split)
+			{
+				rebuildSubtree(order[k], [](const Polygon&) { return false; });
+				skip[k] = true;
+				rebuilt++;
+			}
+		}
+		return rebuilt;
+	}
+
+	template<typename real>
+	CSGHPP_INLINE auto NodeT<real>::chooseSplitter(const std::vector<Polygon>& list) const -> Plane
+	{
+		size_t count = list.size();
+		if (options.splitter == SPLIT_FIRST || count == 1) return list[0].plane;
+
+		// Seed from the list rather than the node index, which depends on
+		// thread timing in parallel builds
+		unsigned state;
+		memcpy(&state, &list[0].plane.w, sizeof(state));
+		state ^= (unsigned)count * 2654435761u ^ options.seed;
+		if (state == 0) state = 1;
+
+		if (options.splitter == SPLIT_RANDOM) return list[nextRandom(state) % count].plane;
+
+		size_t candidates = std::min<size_t>(std::max(options.splitterCandidates, 1u), count);
+		size_t samples = std::min<size_t>(std::max(options.splitterSamples, 1u), count);
+		size_t stride = count / samples;
+		size_t start = nextRandom(state) % (count - (samples - 1) * stride);
+
+		Plane best = list[0].plane;
+		real bestCost = 0.f;
+		for (size_t c = 0; c < candidates; c++)
+		{
+			const Plane& plane = list[candidates == count ? c : nextRandom(state) % count].plane;
+			unsigned front = 0, back = 0, spans = 0;
+			for (size_t k = 0; k < samples; k++)
+			{
+				unsigned type = classifyPolygon(plane, list[start + k * stride], *pool, options.epsilon);
+				if (type == FRONT) front++;
+				else if (type == BACK) back++;
+				else if (type == SPANNING) spans++;
+			}
+			real cost = options.splitCost * spans + fabs(real(front) - real(back));
+			if (options.splitter == SPLIT_AXIS_ALIGNED && isAxisAligned(plane.normal)) cost *= options.axisAlignedCost;
+			if (c == 0 || cost < bestCost)
+			{
+				best = plane;
+				bestCost = cost;
+			}
+		}
+		return best;
+	}
+
+	template<typename real>
+	CSGHPP_INLINE auto NodeT<real>::buildStats() const -> BuildStats
+	{
+		BuildStats stats;
+		stats.splits = splits.load();
+		std::vector< std::pair<unsigned, unsigned> > nodes; // node, depth
+		nodes.push_back(std::make_pair(root, 1u));
+		while (nodes.empty() == false)
+		{
+			std::pair<unsigned, unsigned> item = nodes.back();
+			nodes.pop_back();
+			const BSPNode& n = (*arena)[item.first];
+			stats.nodes++;
+			stats.depth = std::max(stats.depth, item.second);
+			stats.polygons += (unsigned)n.polygons.size();
+			if (n.front != NO_NODE) nodes.push_back(std::make_pair(n.front, item.second + 1));
+			if (n.back != NO_NODE) nodes.push_back(std::make_pair(n.back, item.second + 1));
+		}
+		return stats;
+	}
+
+	template<typename real>
+	CSGHPP_INLINE bool NodeT<real>::solidLeavesBounded() const
+	{
+		std::vector<unsigned> nodes;
+		nodes.push_back(root);
+		while (nodes.empty() == false)
+		{
+			const BSPNode& n = (*arena)[nodes.back()];
+			nodes.pop_back();
+			if (n.back == NO_NODE)
+			{
+				bool facing = false;
+				for (const Polygon& p : n.polygons)
+				{
+					if (dot(p.plane.normal, n.plane.normal) > 0.f) facing = true;
+				}
+				if (!facing) return false;
+			}
+			if (n.front != NO_NODE) nodes.push_back(n.front);
+			if (n.back != NO_NODE) nodes.push_back(n.back);
+		}
+		return true;
+	}
+
+	template<typename real>
+	CSGHPP_INLINE void NodeT<real>::buildNode(unsigned ni, std::vector<Polygon>& list,
+		std::vector<Polygon>& pfront, unsigned& front,
+		std::vector<Polygon>& pback, unsigned& back)
+	{
+		assert(!list.empty() && "list of polys empty");
+		{
+			BSPNode& n = (*arena)[ni];
+			if (!n.plane.ok()) n.plane = chooseSplitter(list);
+			n.entered += (unsigned)list.size();
+			unsigned spans = splitList(n.plane, list, *pool, n.polygons, n.polygons, pfront, pback);
+			n.spans += spans;
+			splits.fetch_add(spans, std::memory_order_relaxed);
+		}
+		front = back = NO_NODE;
+		// alloc() may run on several threads, but nodes never move,
+		// and only the thread building a node writes to it
+		if (pfront.empty() == false)
+		{
+			if ((*arena)[ni].front == NO_NODE) {
+				unsigned child = arena->alloc();
+				(*arena)[ni].front = child;
+			}
+			front = (*arena)[ni].front;
+		}
+		if (pback.empty() == false)
+		{
+			if ((*arena)[ni].back == NO_NODE) {
+				unsigned child = arena->alloc();
+				(*arena)[ni].back = child;
+			}
+			back = (*arena)[ni].back;
+		}
+	}
+
+	template<typename real>
+	CSGHPP_INLINE void NodeT<real>::buildSerial(unsigned start, std::vector<Polygon>&& input)
+	{
+		std::vector<WorkItem> work;
+		work.emplace_back(start, std::move(input));
+
+		while (work.empty() == false)
+		{
+			WorkItem item = std::move(work.back());
+			work.pop_back();
+
+			std::vector<Polygon> pfront, pback;
+			unsigned front, back;
+			buildNode(item.node, item.polygons, pfront, front, pback, back);
+			if (front != NO_NODE) work.emplace_back(front, std::move(pfront));
+			if (back != NO_NODE) work.emplace_back(back, std::move(pback));
+		}
+	}
+
+	template<typename real>
+	CSGHPP_INLINE void NodeT<real>::buildParallel(TaskGroup& group, unsigned ni, std::vector<Polygon>&& list)
+	{
+		std::vector<Polygon> pfront, pback;
+		unsigned front, back;
+		buildNode(ni, list, pfront, front, pback, back);
+
+		std::vector<Polygon>* lists[2] = { &pfront, &pback };
+		unsigned children[2] = { front, back };
+		for (int i = 0; i < 2; i++)
+		{
+			if (children[i] == NO_NODE) continue;
+			if (lists[i]->size() < options.parallelCutoff)
+			{
+				buildSerial(children[i], std::move(*lists[i]));
+				continue;
+			}
+			// Tasks are std::functions, which must be copyable, so the list
+			// goes through a shared_ptr
+			unsigned child = children[i];
+			std::shared_ptr< std::vector<Polygon> > childList = std::make_shared< std::vector<Polygon> >(std::move(*lists[i]));
+			group.run([this, &group, child, childList]()
+			{
+				buildParallel(group, child, std::move(*childList));
+			});
+		}
+	}
+#endif
+
+	// Member templates stay in the header in every build mode, as they
+	// cannot be instantiated ahead for every argument
+	template<typename real>
+	template<typename F>
+	void NodeT<real>::rebuildSubtree(unsigned ni, F drop)
+	{
+		std::vector<Polygon> list;
+		std::vector<unsigned> nodes;
+		nodes.push_back(ni);
+		for (size_t head = 0; head < nodes.size(); head++)
+		{
+			BSPNode& n = (*arena)[nodes[head]];
+			for (Polygon& p : n.polygons)
+			{
+				if (!drop(p)) list.push_back(std::move(p));
+			}
+			n.polygons.clear();
+			if (n.front != NO_NODE) nodes.push_back(n.front);
+			if (n.back != NO_NODE) nodes.push_back(n.back);
+			if (head > 0) arena->release(nodes[head]);
+		}
+
+		BSPNode& n = (*arena)[ni];
+		n.plane = Plane();
+		n.front = n.back = NO_NODE;
+		n.entered = n.spans = 0;
+		if (!list.empty()) buildAt(ni, std::move(list));
+
+		// Record the heights of the new subtree, children after parents
+		nodes.assign(1, ni);
+		std::vector<unsigned> parent(1, 0), height;
+		for (size_t head = 0; head < nodes.size(); head++)
+		{
+			const BSPNode& b = (*arena)[nodes[head]];
+			for (unsigned child : { b.front, b.back })
+			{
+				if (child == NO_NODE) continue;
+				nodes.push_back(child);
+				parent.push_back((unsigned)head);
+			}
+		}
+		height.assign(nodes.size(), 1);
+		for (size_t k = nodes.size(); k-- > 1;) height[parent[k]] = std::max(height[parent[k]], height[k] + 1);
+		for (size_t k = 0; k < nodes.size(); k++) (*arena)[nodes[k]].height = height[k];
+	}
+	
+	template<typename real>
+	struct CSGT {
+		typedef OptionsT<real> Options;
+		typedef tvec3<real> vec3;
+		typedef VertexT<real> Vertex;
+		typedef PolygonT<real> Polygon;
+		typedef VertexPoolT<real> VertexPool;
+		typedef AABBT<real> AABB;
+		typedef NodeArenaT<real> NodeArena;
+		typedef NodeT<real> Node;
+
+		CSGT()
+			: boundsValid(false)
+			, treePolygons(0)
+		{
+		}
+
+		CSGT(VertexPool _pool, std::vector<Polygon> _polygons)
+			: pool(std::move(_pool))
+			, polygons(std::move(_polygons))
+			, boundsValid(false)
+			, treePolygons(0)
+		{
+		}
+
+		// Copies get a copy of the cached BSP tree, if there is one
+		CSGT(const CSGT& o)
+			: pool(o.pool)
+			, polygons(o.polygons)
+			, boundsCache(o.boundsCache)
+			, boundsValid(o.boundsValid)
+			, treeCache(o.treeCache ? new Node(*o.treeCache, pool) : nullptr)
+			, treePolygons(o.treePolygons)
+		{
+		}
+
+		// Moves keep the cached tree, pointed at the new pool
+		CSGT(CSGT&& o)
+			: pool(std::move(o.pool))
+			, polygons(std::move(o.polygons))
+			, boundsCache(o.boundsCache)
+			, boundsValid(o.boundsValid)
+			, treeCache(std::move(o.treeCache))
+			, treePolygons(o.treePolygons)
+		{
+			if (treeCache) treeCache->pool = &pool;
+		}
+
+		CSGT& operator=(const CSGT& o)
+		{
+			if (this != &o) *this = CSGT(o);
+			return *this;
+		}
+
+		CSGT& operator=(CSGT&& o)
+		{
+			if (this != &o)
+			{
+				pool = std::move(o.pool);
+				polygons = std::move(o.polygons);
+				boundsCache = o.boundsCache;
+				boundsValid = o.boundsValid;
+				treeCache = std::move(o.treeCache);
+				treePolygons = o.treePolygons;
+				if (treeCache) treeCache->pool = &pool;
+			}
+			return *this;
+		}
+
+		// Bounding box of all polygons, computed on first use.
+		const AABB& bounds() const
+		{
+			if (!boundsValid)
+			{
+				boundsCache = AABB();
+				for (const Polygon& p : polygons)
+				{
+					boundsCache.add(p.bounds(pool));
+				}
+				boundsValid = true;
+			}
+			return boundsCache;
+		}
+
+		// BSP tree of the polygons, built on first use and kept until invalidate().
+		// The boolean operations use it instead of building the tree again, so
+		// an operand used in many operations only has its tree built once.
+		// Building the tree adds the vertices of split polygons to 'pool', so
+		// this is not const: build the tree before sharing the CSG between
+		// threads, which then only read it.
+		const Node& tree()
+		{
+			if (!treeCache)
+			{
+				cacheTree(std::unique_ptr<Node>(new Node(pool, polygons)));
+			}
+			assert(treeMatches() && "polygons changed without invalidate()");
+			return *treeCache;
+		}
+
+		// Keep 'built', a BSP tree of the current polygons, as the cached tree
+		void cacheTree(std::unique_ptr<Node> built)
+		{
+			treeCache = std::move(built);
+			treePolygons = polygons.size();
+		}
+
+		// The tree built by tree(), or nullptr if there is none
+		const Node* cachedTree() const
+		{
+			return treeCache.get();
+		}
+
+		// Call after changing 'polygons' or vertex positions directly.
+		// Changing other vertex attributes, as setColor() does, keeps the tree,
+		// since it only refers to the vertices by index. Debug builds assert
+		// when a cached tree is used for polygons that have changed.
+		void invalidate()
+		{
+			boundsValid = false;
+			treeCache.reset();
+		}
+
+		// Add a polygon made of copies of the 'count' vertices at 'verts'
+		void addPolygon(const Vertex* verts, size_t count, unsigned shared = 0)
+		{
+			IndexList indices;
+			for (size_t i = 0; i < count; i++)
+			{
+				indices.push_back(pool.add(verts[i]));
+			}
+			polygons.push_back(Polygon(pool, std::move(indices), shared));
+			invalidate();
+		}
+
+		void addPolygon(const std::vector<Vertex>& verts, unsigned shared = 0)
+		{
+			addPolygon(verts.data(), verts.size(), shared);
+		}
+
+		void addPolygon(std::initializer_list<Vertex> verts, unsigned shared = 0)
+		{
+			addPolygon(verts.begin(), verts.size(), shared);
+		}
+
+		// Move the vertices of 'other' into our pool and return its polygons,
+		// renumbered to refer to our pool. 'other' is left empty.
+		std::vector<Polygon> takeOperand(CSGT&& other)
+		{
+			// We get the attributes of both, or those of 'other' if we are empty
+			unsigned attributes = other.pool.attributes;
+			unsigned userAttributes = other.pool.userAttributes();
+			if (pool.size() > 0)
+			{
+				attributes |= pool.attributes;
+				userAttributes = std::max(userAttributes, pool.userAttributes());
+			}
+			if (attributes != pool.attributes || userAttributes != pool.userAttributes())
+			{
+				pool.setAttributes(attributes, userAttributes);
+			}
+			unsigned offset = pool.append(other.pool);
+			std::vector<Polygon> otherPolygons = std::move(other.polygons);
+			for (Polygon& p : otherPolygons)
+			{
+				for (unsigned& vi : p.vertices) vi += offset;
+			}
+			other.pool.clear();
+			other.polygons.clear();
+			other.invalidate();
+			return otherPolygons;
+		}
+
+		// Operands whose bounds do not overlap are combined without BSP trees.
+		bool disjoint(const CSGT& other, real eps = defaultEpsilon<real>()) const
+		{
+			return !bounds().overlaps(other.bounds(), eps);
+		}
+
+		// Drop pool vertices that no polygon uses any more, such as those of
+		// clipped away polygons.
+		void compact();
+
+		// Join fragments split off the same polygon that still share an edge,
+		// as long as the result stays convex. Without this, every operation
+		// adds to the fragments of the previous ones. Vertices where the
+		// fragments met stay in the merged polygon, so no cracks open towards
+		// the neighbouring polygons. Each edge is tried once, plus the edges
+		// that merges bring in, and a merge copies the merged polygon once.
+		// Returns the number of polygons removed.
+		size_t mergeFragments(real epsilon = defaultEpsilon<real>());
+
+		// Per-thread arenas that hold both BSP trees of a boolean operation.
+		// An arena is reset when the operation finishes, freeing both trees at
+		// once while keeping the memory for the next operation.
+		// Operations nest when a thread waiting for the tasks of one operation
+		// runs a task of another (see unionAll), so there is one arena per level.
+		static NodeArena& scratchArena(unsigned depth)
+		{
+			static thread_local std::vector< std::unique_ptr<NodeArena> > arenas;
+			while (arenas.size() <= depth) arenas.emplace_back(new NodeArena);
+			return *arenas[depth];
+		}
+
+		static unsigned& scratchDepth()
+		{
+			static thread_local unsigned depth = 0;
+			return depth;
+		}
+
+		struct ScratchScope
+		{
+			ScratchScope() : arena(scratchArena(scratchDepth()++)) {}
+			~ScratchScope() { arena.reset(); scratchDepth()--; }
+			NodeArena& arena;
+		};
+
+		// Tree for the BSP passes of an operation on this CSGT: the cached tree
+		// if there is one, which the operation then consumes, or a tree built
+		// from our polygons in 'arena' (in an arena of its own for nullptr).
+		// Either way 'polygons' is left empty.
+		Node& ownTree(NodeArena* arena, std::unique_ptr<Node>& holder, const Options& options);
+
+		// As ownTree, for the other operand, which is consumed as by takeOperand
+		Node& operandTree(CSGT&& other, NodeArena& arena, std::unique_ptr<Node>& holder, const Options& options);
+
+		static void recordStats(const Options& options, const Node& a, const Node& b)
+		{
+			if (!options.stats) return;
+			*options.stats += a.buildStats();
+			*options.stats += b.buildStats();
+		}
+
+		// The boolean operations come in two flavours. Called on a temporary,
+		// such as the result of a previous operation, the operands are consumed
+		// and their polygons and vertices are reused for the result. Called on
+		// an lvalue, the operand is copied first. Pass 'other' with std::move
+		// to have it consumed as well.
+		CSGT unionOp(CSGT other, const Options& options = Options::defaults()) const &
+		{
+			return CSGT(*this).unionOp(std::move(other), options);
+		}
+		CSGT unionOp(CSGT other, const Options& options = Options::defaults()) &&;
+		CSGT subOp(CSGT other, const Options& options = Options::defaults()) const &
+		{
+			return CSGT(*this).subOp(std::move(other), options);
+		}
+		CSGT subOp(CSGT other, const Options& options = Options::defaults()) &&;
+		CSGT intersectOp(CSGT other, const Options& options = Options::defaults()) const &
+		{
+			return CSGT(*this).intersectOp(std::move(other), options);
+		}
+		CSGT intersectOp(CSGT other, const Options& options = Options::defaults()) &&;
+
+		// Subtract all of 'others' in turn. Unlike a chain of subOp calls, which
+		// builds a tree for the intermediate result every time, our tree is
+		// built once and updated by every step, so each step only builds a tree
+		// for the next operand. The result keeps its tree for further operations.
+		CSGT subOp(std::vector<CSGT> others, const Options& options = Options::defaults()) const &
+		{
+			return CSGT(*this).subOp(std::move(others), options);
+		}
+		CSGT subOp(std::vector<CSGT> others, const Options& options = Options::defaults()) &&;
+
+		// Union of all 'operands'. Operands are first sorted into groups whose
+		// bounds overlap; groups are disjoint, so they are put together without
+		// any clipping. Within a group, operands are combined as a balanced
+		// binary tree of unions over a spatial median split, so neighbours are
+		// combined first and no operation works on more than its share of the
+		// result. With options.threads the two halves of every split are
+		// combined in parallel.
+		static CSGT unionAll(std::vector<CSGT> operands, const Options& options = Options::defaults());
+
+		// 'body' minus all of 'tools', as one subtraction of their union
+		static CSGT subtractAll(CSGT body, std::vector<CSGT> tools, const Options& options = Options::defaults());
+
+		// Indices of 'operands' in groups, such that the bounds of operands in
+		// different groups do not overlap. Sweeps along x, joining groups with
+		// a union-find.
+		static std::vector< std::vector<unsigned> > overlapGroups(const std::vector<CSGT>& operands, real eps = defaultEpsilon<real>());
+
+		// Union of ops[begin, end), see unionAll
+		static CSGT unionRange(std::vector<CSGT>& ops, size_t begin, size_t end, const Options& options);
+
+		static CSGT cube(vec3 c = vec3(0.f), vec3 radius = 1.0f)
+		{
+			struct IndicesNormal
+			{
+				int indices[4];
+				vec3 normal;
+			};
+			IndicesNormal data[] = {
+		    { {0, 4, 6, 2}, vec3(-1, 0, 0) },
+		    { {1, 3, 7, 5}, vec3(+1, 0, 0) },
+		    { {0, 1, 5, 4}, vec3(0, -1, 0) },
+		    { {2, 6, 7, 3}, vec3(0, +1, 0) },
+		    { {0, 2, 3, 1}, vec3(0, 0, -1) },
+		    { {4, 5, 7, 6}, vec3(0, 0, +1) },
+			};
+			
+			CSGT csg;
+			for (int face=0; face<6; face++)
+			{
+				vec3 normal = data[face].normal;
+				Vertex verts[4];
+				for (int k = 0; k < 4; k++)
+				{
+					int i = data[face].indices[k];
+					vec3 pos = vec3(
+						c.x + radius.x * real(2 * !!(i & 1) - 1),
+						c.y + radius.y * real(2 * !!(i & 2) - 1),
+						c.z + radius.z * real(2 * !!(i & 4) - 1)
+					);
+					verts[k] = Vertex(pos, normal);
+				}
+				csg.addPolygon(verts, 4, 0);
+			}
+
+			return csg;
+		}
+	
+	static CSGT sphere(vec3 center = vec3(0.f), 
+		real radius = 1.0f, int stacks = 8, int slices = 16)
+	{
+		auto pointOnSphere = [&](real theta, real phi)
+		{
+			theta *= 2.f * real(PI);
+			phi *= 1.f * real(PI);
+			auto dir = vec3(
+				(real)std::cos(theta) * std::sin(phi),
+				(real)std::cos(phi),
+				(real)std::sin(theta) * std::sin(phi)
+			);
+			return Vertex(center + (dir * radius), dir);
+		};
+		CSGT csg;
+		Vertex vertices[4];
+		for (real i = 0; i < slices; i++) {
+			for (real j = 0; j < stacks; j++) {
+				size_t n = 0;
+				vertices[n++] = pointOnSphere(i / slices, j / stacks);
+				if (j > 0) vertices[n++] = pointOnSphere((i + 1) / slices, j / stacks);
+				if (j < stacks - 1) vertices[n++] = pointOnSphere((i + 1) / slices, (j + 1) / stacks);
+				vertices[n++] = pointOnSphere(i / slices, (j + 1) / stacks);
+				csg.addPolygon(vertices, n);
+			}
+		}
+		return csg;
+
+	}
+
+	static CSGT cylinder(real radius = 1.f, vec3 start = vec3(0.f, -1.f, 0.f), vec3 end = vec3(0.f, 1.f, 0.f), int slices = 16 )
+	{
+		CSGT csg;
+		
+		vec3 ray = end - start;
+		vec3 axisZ = ray.unit();
+		bool isY = fabs(axisZ.y) > 0.5f;
+		vec3 axisX = cross(vec3(isY, !isY, 0), axisZ).unit();
+		vec3 axisY = cross(axisX, axisZ).unit();
+		Vertex vstart = Vertex(start, -axisZ);
+		Vertex vend = Vertex(end, axisZ.unit());
+		
+		auto point = [&](int stack, real slice, real normalBlend)
+		{
+			real angle = slice * real(PI) * 2.f;
+			vec3 out = axisX * std::cos(angle) + (axisY * std::sin(angle));
+			vec3 pos = start + (ray * stack) + (out * radius);
+			vec3 normal = out * (1.f - fabs(normalBlend)) + (axisZ * normalBlend);
+			return Vertex(pos, normal);
+		};
+		
+		for (int i = 0; i < slices; i++)
+		{
+			real t0 = i / real(slices);
+			real t1 = (i + 1) / real(slices);
+			csg.addPolygon({ vstart, point(0, t0, -1.f), point(0, t1, -1.f) });
+			csg.addPolygon({ point(0, t1, 0.f), point(0, t0, 0.f), point(1, t0, 0.f), point(1, t1, 0.f) });
+			csg.addPolygon({ vend, point(1, t1, 1.f), point(1, t0, 1.f) });
+		}
+		return csg;
+	}
+
+	// Choose the vertex attributes to store, see VertexPool::setAttributes.
+	// Meshes that only need positions save memory and work with 0.
+	void setAttributes(unsigned attributes, unsigned userAttributes = 0)
+	{
+		pool.setAttributes(attributes, userAttributes);
+	}
+
+	// Color all vertices. The cached tree is kept, since it only refers to
+	// the vertices by index.
+	void setColor(float r, float g, float b)
+	{
+		vec3 color = vec3(r, g, b);
+		if (!pool.has(ATTR_COLOR)) pool.setAttributes(pool.attributes | ATTR_COLOR, pool.userAttributes());
+		for (unsigned i = 0; i < pool.size(); i++)
+		{
+			pool.color(i) = color;
+		}
+	}
+
+	VertexPool pool;
+	std::vector<Polygon> polygons;
+	mutable AABB boundsCache;
+	mutable bool boundsValid;
+	std::unique_ptr<Node> treeCache; // see tree()
+	size_t treePolygons; // polygons.size() when the tree was cached
+
+	// False if 'polygons' no longer has the count and bounds it had when the
+	// tree was cached, which means it was changed without invalidate().
+	// Edits that keep both are not caught.
+	bool treeMatches() const
+	{
+		return !treeCache || (treePolygons == polygons.size() && treeCache->bounds.contains(bounds(), defaultEpsilon<real>()));
+	}
+	};
+
+#if CSGHPP_DEFINE_KERNELS
+	template<typename real>
+	CSGHPP_INLINE void CSGT<real>::compact()
+	{
+		const unsigned UNUSED = ~0u;
+		std::vector<unsigned> remap(pool.size(), UNUSED);
+		VertexPool compacted(pool.attributes, pool.userAttributes());
+		for (Polygon& p : polygons)
+		{
+			for (unsigned& vi : p.vertices)
+			{
+				if (remap[vi] == UNUSED) remap[vi] = compacted.add(pool, vi);
+				vi = remap[vi];
+			}
+		}
+		// The cached tree may also use vertices of split polygons
+		if (treeCache)
+		{
+			treeCache->forEachPolygon([&](Polygon& p)
+			{
+				for (unsigned& vi : p.vertices)
+				{
+					if (remap[vi] == UNUSED) remap[vi] = compacted.add(pool, vi);
+					vi = remap[vi];
+				}
+			});
+		}
+		pool = std::move(compacted);
+	}
+
+	template<typename real>
+	CSGHPP_INLINE size_t CSGT<real>::mergeFragments(real epsilon)
+	{
+		// Directed edges of the fragments, in a hash table of chains
+		const unsigned NONE = ~0u;
+		struct Edge
+		{
+			unsigned from, to, polygon, next;
+		};
+		std::vector<Edge> edges;
+		for (unsigned i = 0; i < (unsigned)polygons.size(); i++)
+		{
+			const Polygon& p = polygons[i];
+			if (p.lineage == 0) continue;
+			for (size_t k = 0; k < p.vertices.size(); k++)
+			{
+				edges.push_back(Edge{ p.vertices[k], p.vertices[(k + 1) % p.vertices.size()], i, NONE });
+			}
+		}
+		if (edges.empty()) return 0;
+		size_t bucketCount = 16;
+		while (bucketCount < 2 * edges.size()) bucketCount *= 2;
+		std::vector<unsigned> buckets(bucketCount, NONE);
+		auto bucketOf = [&](unsigned from, unsigned to)
+		{
+			return (from * 73856093u ^ to * 19349663u) & (unsigned)(bucketCount - 1);
+		};
+		for (unsigned e = 0; e < (unsigned)edges.size(); e++)
+		{
+			unsigned h = bucketOf(edges[e].from, edges[e].to);
+			edges[e].next = buckets[h];
+			buckets[h] = e;
+		}
+
+		// Merged polygons forward to the one they went into. The chains are
+		// shortened on the way, so following them stays cheap.
+		std::vector<unsigned> mergedInto(polygons.size(), NONE);
+		auto owner = [&](unsigned i)
+		{
+			unsigned root = i;
+			while (mergedInto[root] != NONE) root = mergedInto[root];
+			while (mergedInto[i] != NONE)
+			{
+				unsigned next = mergedInto[i];
+				mergedInto[i] = root;
+				i = next;
+			}
+			return root;
+		};
+		auto positionOf = [](const Polygon& p, unsigned from, unsigned to)
+		{
+			for (size_t k = 0; k < p.vertices.size(); k++)
+			{
+				if (p.vertices[k] == from && p.vertices[(k + 1) % p.vertices.size()] == to) return k;
+			}
+			return (size_t)p.vertices.size();
+		};
+		// True if the corner at 'cur' turns the way of 'normal', or not at all
+		auto convex = [&](const vec3& normal, unsigned prev, unsigned cur, unsigned next)
+		{
+			vec3 a = pool.pos(cur) - pool.pos(prev), b = pool.pos(next) - pool.pos(cur);
+			return dot(cross(a, b), normal) >= -epsilon * (a.length() + b.length());
+		};
+
+		size_t removed = 0;
+		IndexList merged;
+		// Vertices of the polygon being grown are marked with its number
+		std::vector<unsigned> mark(pool.size(), NONE);
+		for (unsigned i = 0; i < (unsigned)polygons.size(); i++)
+		{
+			if (polygons[i].lineage == 0 || mergedInto[i] != NONE) continue;
+			for (unsigned v : polygons[i].vertices) mark[v] = i;
+			// Walk the edges once: a merge puts the edges it brings in, and
+			// those not tried yet, first, and the walk goes on from there
+			size_t k = 0, todo = polygons[i].vertices.size();
+			while (todo > 0)
+			{
+				Polygon& p = polygons[i];
+				size_t n = p.vertices.size();
+				unsigned a = p.vertices[k], b = p.vertices[(k + 1) % n];
+				bool done = false;
+				for (unsigned e = buckets[bucketOf(b, a)]; e != NONE && !done; e = edges[e].next)
+				{
+					if (edges[e].from != b || edges[e].to != a) continue;
+					unsigned j = owner(edges[e].polygon);
+					if (j == i) continue;
+					const Polygon& q = polygons[j];
+					// Lineages of separate runs may clash, so the planes must match too
+					if (q.lineage != p.lineage || q.flipped != p.flipped || q.plane.w != p.plane.w ||
+						q.plane.normal.x != p.plane.normal.x || q.plane.normal.y != p.plane.normal.y ||
+						q.plane.normal.z != p.plane.normal.z)
+					{
+						continue;
+					}
+					size_t m = positionOf(q, b, a);
+					size_t nq = q.vertices.size();
+					if (m == nq) continue;
+
+					// a, q between a and b, then p from b round to before a
+					merged.clear();
+					for (size_t t = 1; t < nq; t++) merged.push_back(q.vertices[(m + t) % nq]);
+					for (size_t t = 1; t < n; t++) merged.push_back(p.vertices[(k + t) % n]);
+					bool ok = convex(p.plane.normal, merged.back(), a, merged[1]) &&
+						convex(p.plane.normal, merged[nq - 2], b, merged[nq % merged.size()]);
+					// Fragments meeting along more than this edge would leave a seam
+					for (size_t t = 2; t < nq && ok; t++) ok = mark[q.vertices[(m + t) % nq]] != i;
+					if (!ok) continue;
+
+					for (size_t t = 2; t < nq; t++) mark[q.vertices[(m + t) % nq]] = i;
+					std::swap(p.vertices, merged);
+					polygons[j].vertices.clear();
+					mergedInto[j] = i;
+					removed++;
+					// The nq - 1 edges from q, then the todo - 1 edges of p after this one
+					k = 0;
+					todo += nq - 2;
+					done = true;
+				}
+				if (!done)
+				{
+					k = (k + 1) % n;
+					todo--;
+				}
+			}
+		}
+
+		size_t out = 0;
+		for (size_t i = 0; i < polygons.size(); i++)
+		{
+			if (mergedInto[i] != NONE) continue;
+			if (out != i) polygons[out] = std::move(polygons[i]);
+			out++;
+		}
+		polygons.resize(out);
+		// The merged polygons cover the same surface, so a cached tree still
+		// describes them
+		treePolygons = polygons.size();
+		return removed;
+	}
+
+	template<typename real>
+	CSGHPP_INLINE auto CSGT<real>::ownTree(NodeArena* arena, std::unique_ptr<Node>& holder, const Options& options) -> Node&
+	{
+		if (treeCache)
+		{
+			assert(treeMatches() && "polygons changed without invalidate()");
+			holder = std::move(treeCache);
+			holder->pool = &pool;
+			holder->options = options;
+			polygons.clear();
+		}
+		else if (arena)
+		{
+			holder.reset(new Node(*arena, pool, std::move(polygons), options));
+		}
+		else
+		{
+			holder.reset(new Node(pool, std::move(polygons), options));
+		}
+		return *holder;
+	}
+
+	template<typename real>
+	CSGHPP_INLINE auto CSGT<real>::operandTree(CSGT&& other, NodeArena& arena, std::unique_ptr<Node>& holder, const Options& options) -> Node&
+	{
+		unsigned offset = pool.size();
+		assert(other.treeMatches() && "polygons changed without invalidate()");
+		std::unique_ptr<Node> cached = std::move(other.treeCache);
+		std::vector<Polygon> otherPolygons = takeOperand(std::move(other));
+		if (cached)
+		{
+			cached->forEachPolygon([offset](Polygon& p)
+			{
+				for (unsigned& vi : p.vertices) vi += offset;
+			});
+			cached->pool = &pool;
+			cached->options = options;
+			holder = std::move(cached);
+		}
+		else
+		{
+			holder.reset(new Node(arena, pool, std::move(otherPolygons), options));
+		}
+		return *holder;
+	}
+
+	template<typename real>
+	CSGHPP_INLINE auto CSGT<real>::unionOp(CSGT other, const Options& options) && -> CSGT
+	{
+		if (disjoint(other, options.epsilon))
+		{
+			Node::concat(polygons, takeOperand(std::move(other)));
+			invalidate();
+			return std::move(*this);
+		}
+		ScratchScope scratch;
+		std::unique_ptr<Node> treeA, treeB;
+		Node& a = ownTree(&scratch.arena, treeA, options);
+		Node& b = operandTree(std::move(other), scratch.arena, treeB, options);
+		a.clipTo(b);
+		b.clipTo(a);
+		b.invert();
+		b.clipTo(a);
+		b.invert();
+		a.build(b.takeAllPolygons());
+		recordStats(options, a, b);
+		polygons = a.takeAllPolygons();
+		if (options.mergeFragments) mergeFragments(options.epsilon);
+		compact();
+		invalidate();
+		return std::move(*this);
+	}
+
+	template<typename real>
+	CSGHPP_INLINE auto CSGT<real>::subOp(CSGT other, const Options& options) && -> CSGT
+	{
+		if (disjoint(other, options.epsilon)) return std::move(*this);
+		ScratchScope scratch;
+		std::unique_ptr<Node> treeA, treeB;
+		Node& a = ownTree(&scratch.arena, treeA, options);
+		Node& b = operandTree(std::move(other), scratch.arena, treeB, options);
+		a.invert();
+		a.clipTo(b);
+		b.clipTo(a);
+		b.invert();
+		b.clipTo(a);
+		b.invert();
+		a.build(b.takeAllPolygons());
+		a.invert();
+		recordStats(options, a, b);
+		polygons = a.takeAllPolygons();
+		if (options.mergeFragments) mergeFragments(options.epsilon);
+		compact();
+		invalidate();
+		return std::move(*this);
+	}
+
+	template<typename real>
+	CSGHPP_INLINE auto CSGT<real>::intersectOp(CSGT other, const Options& options) && -> CSGT
+	{
+		if (disjoint(other, options.epsilon)) return CSGT();
+		ScratchScope scratch;
+		std::unique_ptr<Node> treeA, treeB;
+		Node& a = ownTree(&scratch.arena, treeA, options);
+		Node& b = operandTree(std::move(other), scratch.arena, treeB, options);
+		a.invert();
+		b.clipTo(a);
+		b.invert();
+		a.clipTo(b);
+		b.clipTo(a);
+		a.build(b.takeAllPolygons());
+		a.invert();
+		recordStats(options, a, b);
+		polygons = a.takeAllPolygons();
+		if (options.mergeFragments) mergeFragments(options.epsilon);
+		compact();
+		invalidate();
+		return std::move(*this);
+	}
+
+	template<typename real>
+	CSGHPP_INLINE auto CSGT<real>::subOp(std::vector<CSGT> others, const Options& options) && -> CSGT
+	{
+		std::unique_ptr<Node> body;
+		for (CSGT& other : others)
+		{
+			if (body ? !body->bounds.overlaps(other.bounds(), options.epsilon) : disjoint(other, options.epsilon)) continue;
+			if (!body) ownTree(nullptr, body, options);
+			ScratchScope scratch;
+			std::unique_ptr<Node> treeB;
+			Node& a = *body;
+			Node& b = operandTree(std::move(other), scratch.arena, treeB, options);
+			a.invert();
+			a.clipTo(b);
+			b.clipTo(a);
+			b.invert();
+			b.clipTo(a);
+			b.invert();
+			a.build(b.takeAllPolygons());
+			a.invert();
+			recordStats(options, a, b);
+
+			// Start over from the polygons if the tree stopped describing
+			// them, or if it is mostly made of nodes that were clipped empty.
+			// A freshly built tree has at most one node per polygon, as each
+			// node keeps the polygon it splits on; past 4 nodes per polygon
+			// most of the tree is empty cells. The bound only has to stop
+			// the growth: batches of 24 to 40 crossing holes run up to twice
+			// as long without it, and bounds from 1 to 16 nodes per polygon
+			// time the same. The 64 keeps small trees from being rebuilt
+			// over a few empty nodes.
+			BuildStats shape = a.buildStats();
+			if (!a.solidLeavesBounded() || shape.nodes > 4 * shape.polygons + 64)
+			{
+				polygons = a.takeAllPolygons();
+				body.reset();
+				boundsValid = false;
+			}
+		}
+		if (body) polygons = body->allPolygons();
+		if (options.mergeFragments) mergeFragments(options.epsilon);
+		if (body) cacheTree(std::move(body));
+		compact();
+		boundsValid = false;
+		return std::move(*this);
+	}
+
+	template<typename real>
+	CSGHPP_INLINE auto CSGT<real>::unionAll(std::vector<CSGT> operands, const Options& options) -> CSGT
+	{
+		CSGT result;
+		for (std::vector<unsigned>& group : overlapGroups(operands, options.epsilon))
+		{
+			std::vector<CSGT> members;
+			for (unsigned i : group) members.push_back(std::move(operands[i]));
+			CSGT merged = unionRange(members, 0, members.size(), options);
+			Node::concat(result.polygons, result.takeOperand(std::move(merged)));
+		}
+		result.invalidate();
+		return result;
+	}
+
+	template<typename real>
+	CSGHPP_INLINE auto CSGT<real>::subtractAll(CSGT body, std::vector<CSGT> tools, const Options& options) -> CSGT
+	{
+		std::vector<CSGT> touching;
+		for (CSGT& t : tools)
+		{
+			if (!body.disjoint(t, options.epsilon)) touching.push_back(std::move(t));
+		}
+		if (touching.empty()) return body;
+		return std::move(body).subOp(unionAll(std::move(touching), options), options);
+	}
+
+	template<typename real>
+	CSGHPP_INLINE auto CSGT<real>::overlapGroups(const std::vector<CSGT>& operands, real eps) -> std::vector< std::vector<unsigned> >
+	{
+		unsigned count = (unsigned)operands.size();
+		std::vector<unsigned> order(count), parent(count);
+		for (unsigned i = 0; i < count; i++) order[i] = parent[i] = i;
+		std::sort(order.begin(), order.end(), [&operands](unsigned a, unsigned b)
+		{
+			return operands[a].bounds().min.x < operands[b].bounds().min.x;
+		});
+		auto find = [&parent](unsigned i)
+		{
+			while (parent[i] != i) i = parent[i] = parent[parent[i]];
+			return i;
+		};
+
+		std::vector<unsigned> active;
+		for (unsigned i : order)
+		{
+			const AABB& b = operands[i].bounds();
+			if (b.empty()) continue;
+			size_t kept = 0;
+			for (unsigned j : active)
+			{
+				const AABB& o = operands[j].bounds();
+				if (o.max.x + eps < b.min.x) continue; // behind the sweep
+				active[kept++] = j;
+				if (o.overlaps(b, eps)) parent[find(i)] = find(j);
+			}
+			active.resize(kept);
+			active.push_back(i);
+		}
+
+		std::vector< std::vector<unsigned> > groups;
+		std::vector<unsigned> groupOf(count, ~0u);
+		for (unsigned i : order)
+		{
+			if (operands[i].bounds().empty()) continue;
+			unsigned root = find(i);
+			if (groupOf[root] == ~0u)
+			{
+				groupOf[root] = (unsigned)groups.size();
+				groups.push_back(std::vector<unsigned>());
+			}
+			groups[groupOf[root]].push_back(i);
+		}
+		return groups;
+	}
+
+	template<typename real>
+	CSGHPP_INLINE auto CSGT<real>::unionRange(std::vector<CSGT>& ops, size_t begin, size_t end, const Options& options) -> CSGT
+	{
+		if (end - begin == 1) return std::move(ops[begin]);
+
+		// Split at the median along the axis in which the centers spread most
+		AABB centers;
+		for (size_t i = begin; i < end; i++)
+		{
+			const AABB& b = ops[i].bounds();
+			centers.add((b.min + b.max) * 0.5f);
+		}
+		vec3 extent = centers.max - centers.min;
+		int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+		size_t mid = (begin + end) / 2;
+		auto key = [axis](const CSGT& c)
+		{
+			vec3 m = c.bounds().min + c.bounds().max;
+			return axis == 0 ? m.x : (axis == 1 ? m.y : m.z);
+		};
+		std::nth_element(ops.begin() + begin, ops.begin() + mid, ops.begin() + end, [&key](const CSGT& a, const CSGT& b)
+		{
+			return key(a) < key(b);
+		});
+
+		CSGT left, right;
+		if (options.threads)
+		{
+			TaskGroup group(*options.threads);
+			group.run([&]() { left = unionRange(ops, begin, mid, options); });
+			right = unionRange(ops, mid, end, options);
+			group.wait();
+		}
+		else
+		{
+			left = unionRange(ops, begin, mid, options);
+			right = unionRange(ops, mid, end, options);
+		}
+		return std::move(left).unionOp(std::move(right), options);
+	}
+#endif
+
+	template<typename real>
+	bool operator==(const VertexT<real>& a, const VertexT<real>& b)
+	{
 		return
 			a.pos.x == b.pos.x &&
 			a.pos.y == b.pos.y &&
 			a.pos.z == b.pos.z &&
 			a.normal.x == b.normal.x &&
 			a.normal.y == b.normal.y &&
-			a.normal.z == b.normal.z;
+			a.normal.z == b.normal.z &&
+			a.uv.x == b.uv.x &&
+			a.uv.y == b.uv.y;
+	}
+
+	// IEEE half precision, rounded to nearest even
+	inline uint16_t floatToHalf(float f)
+	{
+		uint32_t x;
+		memcpy(&x, &f, sizeof(x));
+		uint32_t sign = (x >> 16) & 0x8000, abs = x & 0x7fffffff;
+		if (abs >= 0x7f800000) return (uint16_t)(sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0)); // inf, nan
+		if (abs >= 0x477ff000) return (uint16_t)(sign | 0x7c00); // 65520 and up round to inf
+		if (abs < 0x38800000)
+		{
+			// Subnormal, in units of 2^-24
+			if (abs < 0x33000000) return (uint16_t)sign;
+			uint32_t shift = 126 - (abs >> 23), m = (abs & 0x7fffff) | 0x800000;
+			uint32_t h = m >> shift, rest = m & ((1u << shift) - 1), half = 1u << (shift - 1);
+			if (rest > half || (rest == half && (h & 1))) h++;
+			return (uint16_t)(sign | h);
+		}
+		// Rounding up may carry into the exponent, which is still right
+		uint32_t h = (abs - 0x38000000) >> 13, rest = abs & 0x1fff;
+		if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) h++;
+		return (uint16_t)(sign | h);
+	}
+
+	inline float halfToFloat(uint16_t h)
+	{
+		uint32_t sign = (uint32_t)(h & 0x8000) << 16, e = (h >> 10) & 0x1f, m = h & 0x3ff, x;
+		if (e == 0)
+		{
+			float f = m * (1.f / 16777216.f);
+			return sign ? -f : f;
+		}
+		x = e == 0x1f ? (sign | 0x7f800000 | (m << 13)) : (sign | ((e + 112) << 23) | (m << 13));
+		float f;
+		memcpy(&f, &x, sizeof(f));
+		return f;
+	}
+
+	// Unit vector as a point of the octahedron |x| + |y| + |z| = 1, with the
+	// lower half folded out over the corners, in two signed 16 bit values
+	template<typename real>
+	void octahedralEncode(const tvec3<real>& n, int16_t out[2])
+	{
+		real l1 = fabs(n.x) + fabs(n.y) + fabs(n.z), x = 0, y = 0;
+		if (l1 > 0)
+		{
+			x = n.x / l1;
+			y = n.y / l1;
+			if (n.z < 0)
+			{
+				real fx = x;
+				x = (1 - fabs(y)) * (fx >= 0 ? 1 : -1);
+				y = (1 - fabs(fx)) * (y >= 0 ? 1 : -1);
+			}
+		}
+		out[0] = (int16_t)floor(std::max(real(-1), std::min(real(1), x)) * 32767 + real(0.5));
+		out[1] = (int16_t)floor(std::max(real(-1), std::min(real(1), y)) * 32767 + real(0.5));
+	}
+
+	template<typename real>
+	tvec3<real> octahedralDecode(const int16_t in[2])
+	{
+		tvec3<real> n(std::max(real(in[0]) / 32767, real(-1)), std::max(real(in[1]) / 32767, real(-1)), 0);
+		n.z = 1 - fabs(n.x) - fabs(n.y);
+		if (n.z < 0)
+		{
+			real fx = n.x;
+			n.x = (1 - fabs(n.y)) * (fx >= 0 ? 1 : -1);
+			n.y = (1 - fabs(fx)) * (n.y >= 0 ? 1 : -1);
+		}
+		return n.unit();
 	}
 
-	struct Model
+	struct PackOptions
+	{
+		// Formats of a PackedMesh. By default the attributes are floats and
+		// the indices 16 bit where they fit.
+		PackOptions()
+			: halfPositions(false)
+			, octahedralNormals(false)
+			, rgba8Colors(false)
+			, halfUVs(false)
+			, normals(true)
+			, colors(true)
+			, uvs(true)
+			, shortIndices(true)
+		{
+		}
+
+		// Half positions and UVs, octahedral normals and 8 bit colors: 20 bytes a vertex instead of 44
+		static PackOptions compact()
+		{
+			PackOptions options;
+			options.halfPositions = options.octahedralNormals = options.rgba8Colors = options.halfUVs = true;
+			return options;
+		}
+
+		bool halfPositions;     // 4 halves, w = 1, instead of 3 floats
+		bool octahedralNormals; // 2 snorm16, see octahedralEncode(), instead of 3 floats
+		bool rgba8Colors;       // 4 unorm8, alpha 255, instead of 3 floats
+		bool halfUVs;           // 2 halves instead of 2 floats
+		// Attributes to leave out when false
+		bool normals;
+		bool colors;
+		bool uvs;
+		// 16 bit indices if there are fewer than 65535 vertices, so that
+		// 0xffff stays free for primitive restart
+		bool shortIndices;
+	};
+
+	struct PackedMesh
+	{
+		// Interleaved vertex buffer and index buffer of a Model, laid out as
+		// the GPU reads them, see Model::pack(). All attributes are 4 byte aligned.
+		PackedMesh()
+			: stride(0)
+			, vertexCount(0)
+			, indexSize(4)
+			, indexCount(0)
+			, positionOffset(ABSENT)
+			, normalOffset(ABSENT)
+			, colorOffset(ABSENT)
+			, uvOffset(ABSENT)
+		{
+		}
+
+		enum : unsigned { ABSENT = ~0u };
+
+		std::vector<uint8_t> vertices; // vertexCount * stride bytes
+		std::vector<uint8_t> indices;  // indexCount * indexSize bytes
+		unsigned stride;
+		unsigned vertexCount;
+		unsigned indexSize; // 2 or 4
+		unsigned indexCount;
+		// Byte offsets of the attributes within a vertex, or ABSENT
+		unsigned positionOffset;
+		unsigned normalOffset;
+		unsigned colorOffset;
+		unsigned uvOffset;
+		// The formats of the attributes
+		PackOptions options;
+	};
+
+	template<typename real>
+	struct ModelT
 	{
+		typedef tvec3<real> vec3;
+		typedef VertexT<real> Vertex;
+
+		// Indexed triangle mesh.
+		// Vertices are welded through a hash table so building a Model is linear
+		// in the number of polygon vertices. With weldEpsilon == 0 only vertices
+		// that compare equal with operator== are merged, otherwise positions
+		// closer than weldEpsilon (and normals and UVs within weldEpsilon per component)
+		// are merged using a uniform grid of cell size weldEpsilon.
+		ModelT(real _weldEpsilon = 0.f)
+			: weldEpsilon(_weldEpsilon)
+		{
+		}
+
 		std::vector<Vertex> vertices;
 		std::vector<unsigned> index;
+		real weldEpsilon;
 
 		unsigned addVertex(const Vertex& nv)
 		{
-			unsigned i = 0;
-			for (const Vertex& v : vertices)
+			if (buckets.size() < 2 * (vertices.size() + 1)) rehash(4 * (vertices.size() + 1));
+
+			if (weldEpsilon > 0.f)
 			{
-				if (v == nv)
+				// Weld to the nearest match, so that the result does not
+				// depend on the order of the hash chains
+				int64_t cx, cy, cz;
+				cellOf(nv.pos, cx, cy, cz);
+				unsigned best = NONE;
+				real bestDistance = 0;
+				for (int dz = -1; dz <= 1; dz++)
+				for (int dy = -1; dy <= 1; dy++)
+				for (int dx = -1; dx <= 1; dx++)
 				{
-					return i;
+					unsigned h = hashCell(cx + dx, cy + dy, cz + dz) & (unsigned)(buckets.size() - 1);
+					for (unsigned i = buckets[h]; i != NONE; i = next[i])
+					{
+						if (!isNear(vertices[i], nv)) continue;
+						vec3 d = vertices[i].pos - nv.pos;
+						real distance = dot(d, d);
+						if (best == NONE || distance < bestDistance || (distance == bestDistance && i < best))
+						{
+							best = i;
+							bestDistance = distance;
+						}
+					}
+				}
+				if (best != NONE) return best;
+			}
+			else
+			{
+				unsigned h = hashExact(nv) & (unsigned)(buckets.size() - 1);
+				for (unsigned i = buckets[h]; i != NONE; i = next[i])
+				{
+					if (vertices[i] == nv) return i;
 				}
-				++i;
 			}
+
+			unsigned i = (unsigned)vertices.size();
 			vertices.push_back(nv);
+			link(i);
 			return i;
 		}
+
+		// Interleaved buffers for drawing, in the formats of 'options'
+		PackedMesh pack(const PackOptions& options = PackOptions()) const
+		{
+			PackedMesh p;
+			p.options = options;
+			unsigned stride = 0;
+			p.positionOffset = stride;
+			stride += options.halfPositions ? 8 : 12;
+			if (options.normals)
+			{
+				p.normalOffset = stride;
+				stride += options.octahedralNormals ? 4 : 12;
+			}
+			if (options.colors)
+			{
+				p.colorOffset = stride;
+				stride += options.rgba8Colors ? 4 : 12;
+			}
+			if (options.uvs)
+			{
+				p.uvOffset = stride;
+				stride += options.halfUVs ? 4 : 8;
+			}
+			p.stride = stride;
+			p.vertexCount = (unsigned)vertices.size();
+			p.vertices.resize((size_t)stride * vertices.size());
+
+			auto putFloats = [](uint8_t* out, real a, real b, real c, int n)
+			{
+				float f[3] = { (float)a, (float)b, (float)c };
+				memcpy(out, f, n * sizeof(float));
+			};
+			auto putHalves = [](uint8_t* out, real a, real b, real c, real d, int n)
+			{
+				uint16_t h[4] = { floatToHalf((float)a), floatToHalf((float)b), floatToHalf((float)c), floatToHalf((float)d) };
+				memcpy(out, h, n * sizeof(uint16_t));
+			};
+			auto unorm8 = [](real v) { return (uint8_t)floor(std::max(real(0), std::min(real(1), v)) * 255 + real(0.5)); };
+			for (size_t i = 0; i < vertices.size(); i++)
+			{
+				const Vertex& v = vertices[i];
+				uint8_t* out = &p.vertices[i * stride];
+				if (options.halfPositions) putHalves(out + p.positionOffset, v.pos.x, v.pos.y, v.pos.z, 1, 4);
+				else putFloats(out + p.positionOffset, v.pos.x, v.pos.y, v.pos.z, 3);
+				if (options.normals)
+				{
+					if (options.octahedralNormals)
+					{
+						int16_t n[2];
+						octahedralEncode(v.normal, n);
+						memcpy(out + p.normalOffset, n, sizeof(n));
+					}
+					else putFloats(out + p.normalOffset, v.normal.x, v.normal.y, v.normal.z, 3);
+				}
+				if (options.colors)
+				{
+					if (options.rgba8Colors)
+					{
+						uint8_t* c = out + p.colorOffset;
+						c[0] = unorm8(v.color.x);
+						c[1] = unorm8(v.color.y);
+						c[2] = unorm8(v.color.z);
+						c[3] = 255;
+					}
+					else putFloats(out + p.colorOffset, v.color.x, v.color.y, v.color.z, 3);
+				}
+				if (options.uvs)
+				{
+					if (options.halfUVs) putHalves(out + p.uvOffset, v.uv.x, v.uv.y, 0, 0, 2);
+					else putFloats(out + p.uvOffset, v.uv.x, v.uv.y, 0, 2);
+				}
+			}
+
+			p.indexCount = (unsigned)index.size();
+			if (options.shortIndices && vertices.size() < 0xffff)
+			{
+				p.indexSize = 2;
+				p.indices.resize(index.size() * 2);
+				uint16_t* out = (uint16_t*)p.indices.data();
+				for (size_t i = 0; i < index.size(); i++) out[i] = (uint16_t)index[i];
+			}
+			else
+			{
+				p.indexSize = 4;
+				p.indices.resize(index.size() * 4);
+				if (!index.empty()) memcpy(p.indices.data(), index.data(), index.size() * 4);
+			}
+			return p;
+		}
+
+		// Hash table of chains through 'next', one chain per bucket.
+		enum : unsigned { NONE = ~0u };
+		std::vector<unsigned> buckets;
+		std::vector<unsigned> next;
+
+		static unsigned hashBits(unsigned h, real v)
+		{
+			v += 0.f; // -0 and +0 compare equal, so they must hash equal
+			uint64_t bits = 0;
+			memcpy(&bits, &v, sizeof(v));
+			h ^= (unsigned)bits ^ (unsigned)(bits >> 32);
+			h *= 16777619u;
+			return h ^ (h >> 15);
+		}
+
+		static unsigned hashExact(const Vertex& v)
+		{
+			unsigned h = 2166136261u;
+			h = hashBits(h, v.pos.x);
+			h = hashBits(h, v.pos.y);
+			h = hashBits(h, v.pos.z);
+			h = hashBits(h, v.normal.x);
+			h = hashBits(h, v.normal.y);
+			h = hashBits(h, v.normal.z);
+			return h;
+		}
+
+		static unsigned hashCell(int64_t x, int64_t y, int64_t z)
+		{
+			uint64_t h = ((uint64_t)x * 73856093u) ^ ((uint64_t)y * 19349663u) ^ ((uint64_t)z * 83492791u);
+			return (unsigned)h ^ (unsigned)(h >> 32);
+		}
+
+		// Grid cell of coordinate 'x' for cells of size 'cell'. Cells are
+		// clamped to +-2^62, so that positions far out or not finite, whose
+		// cell does not fit an integer, share the last cell instead of
+		// overflowing; neighbours of a clamped cell still fit.
+		static int64_t cellCoord(real x, real cell)
+		{
+			const double limit = 4611686018427387904.0;
+			double c = floor((double)x / (double)cell);
+			if (!(c > -limit)) return -(int64_t)limit;
+			if (c > limit) return (int64_t)limit;
+			return (int64_t)c;
+		}
+
+		void cellOf(vec3 p, int64_t& x, int64_t& y, int64_t& z) const
+		{
+			x = cellCoord(p.x, weldEpsilon);
+			y = cellCoord(p.y, weldEpsilon);
+			z = cellCoord(p.z, weldEpsilon);
+		}
+
+		bool isNear(const Vertex& a, const Vertex& b) const
+		{
+			vec3 d = a.pos - b.pos;
+			vec3 n = a.normal - b.normal;
+			return dot(d, d) <= weldEpsilon * weldEpsilon &&
+				fabs(n.x) <= weldEpsilon &&
+				fabs(n.y) <= weldEpsilon &&
+				fabs(n.z) <= weldEpsilon &&
+				fabs(a.uv.x - b.uv.x) <= weldEpsilon &&
+				fabs(a.uv.y - b.uv.y) <= weldEpsilon;
+		}
+
+		unsigned bucketOf(const Vertex& v) const
+		{
+			unsigned h;
+			if (weldEpsilon > 0.f)
+			{
+				int64_t x, y, z;
+				cellOf(v.pos, x, y, z);
+				h = hashCell(x, y, z);
+			}
+			else
+			{
+				h = hashExact(v);
+			}
+			return h & (unsigned)(buckets.size() - 1);
+		}
+
+		void link(unsigned i)
+		{
+			unsigned h = bucketOf(vertices[i]);
+			next.resize(vertices.size());
+			next[i] = buckets[h];
+			buckets[h] = i;
+		}
+
+		void rehash(size_t minBuckets)
+		{
+			size_t n = 16;
+			while (n < minBuckets) n *= 2;
+			buckets.assign(n, NONE);
+			next.assign(vertices.size(), NONE);
+			for (unsigned i = 0; i < (unsigned)vertices.size(); i++)
+			{
+				link(i);
+			}
+		}
 	};
 
-	Model fromPolygons(const std::vector<Polygon>& polys)
+	template<typename real>
+	ModelT<real> fromPolygons(const VertexPoolT<real>& pool, const std::vector< PolygonT<real> >& polys,
+		typename NonDeduced<real>::type weldEpsilon = 0.f)
 	{
-		Model m;
-		for (const Polygon& poly : polys)
+		ModelT<real> m(weldEpsilon);
+		size_t vertex_count = 0;
+		for (const PolygonT<real>& poly : polys)
+		{
+			vertex_count += poly.vertices.size();
+		}
+		m.vertices.reserve(vertex_count);
+		m.rehash(2 * vertex_count);
+
+		for (const PolygonT<real>& poly : polys)
 		{
 			if (poly.vertices.empty()) continue;
 
-			unsigned a = m.addVertex(poly.vertices[0]);
+			unsigned a = m.addVertex(poly.vertex(pool, 0));
 			for (size_t i = 2; i < poly.vertices.size(); i++)
 			{
-				auto b = m.addVertex( poly.vertices[i-1] );
-				auto c = m.addVertex(poly.vertices[i]);
+				auto b = m.addVertex( poly.vertex(pool, i-1) );
+				auto c = m.addVertex(poly.vertex(pool, i));
 				if (a != b && b != c && c != a)
 				{
 					m.index.push_back(a);
@@ -661,10 +3654,623 @@ void splitPolygon(
 		return m;
 	}
 
-	void stats(CSG &o)
+	template<typename real>
+	ModelT<real> fromPolygons(const CSGT<real>& csg, typename NonDeduced<real>::type weldEpsilon = 0.f)
+	{
+		return fromPolygons(csg.pool, csg.polygons, weldEpsilon);
+	}
+
+	// How fromPolygons splits polygons into triangles
+	enum eTriangulation {
+		TRIANGULATE_FAN,      // fan from the first vertex that gives no flat triangles
+		TRIANGULATE_BEST_FAN, // fan from the vertex whose worst triangle is best shaped
+		TRIANGULATE_EAR_CLIP, // cut off the best shaped ear until a triangle is left
+	};
+
+	struct MeshReport
+	{
+		// Watertightness of a Model, see checkWatertight(). Edges are told
+		// apart by the positions of their ends, so vertices that differ only
+		// in their normals or UVs, as along creases, do not open the mesh.
+		MeshReport()
+			: boundaryEdges(0)
+			, nonManifoldEdges(0)
+			, tJunctions(0)
+		{
+		}
+
+		bool watertight() const { return boundaryEdges == 0 && nonManifoldEdges == 0; }
+
+		unsigned boundaryEdges;    // triangle edges without a triangle on the other side
+		unsigned nonManifoldEdges; // edges of more than two triangles
+		unsigned tJunctions;       // vertices fromPolygons added to edges they lay on
+	};
+
+	template<typename real>
+	struct MeshOptionsT
+	{
+		// How fromPolygons builds a Model of the same scalar type
+		MeshOptionsT()
+			: weldEpsilon(0.f)
+			, repair(false)
+			, epsilon(defaultEpsilon<real>())
+			, triangulation(TRIANGULATE_FAN)
+			, optimizeOrder(false)
+			, cacheSize(32)
+			, report(nullptr)
+		{
+		}
+
+		// See ModelT
+		real weldEpsilon;
+		// Close the cracks of the BSP output: positions closer than 'epsilon'
+		// become one, and a vertex lying on the edge of another polygon, a
+		// T-junction, is added to that edge
+		bool repair;
+		real epsilon;
+		eTriangulation triangulation;
+		// Reorder the triangles for the vertex cache of the GPU and the
+		// vertices in the order the triangles use them, see optimizeIndexOrder()
+		bool optimizeOrder;
+		unsigned cacheSize;
+		// If set, receives the watertightness of the Model
+		MeshReport* report;
+	};
+
+	// Count the edges of 'm' that are open or shared by more than two triangles
+	template<typename real>
+	MeshReport checkWatertight(const ModelT<real>& m)
+	{
+		typedef VertexT<real> Vertex;
+		// Number the distinct positions
+		ModelT<real> points;
+		std::vector<unsigned> point(m.vertices.size());
+		for (size_t i = 0; i < m.vertices.size(); i++)
+		{
+			point[i] = points.addVertex(Vertex(m.vertices[i].pos, tvec3<real>(0.f)));
+		}
+
+		// Both directions of each edge, the lower point first, sorted together
+		std::vector<uint64_t> edges;
+		edges.reserve(m.index.size());
+		for (size_t t = 0; t + 2 < m.index.size(); t += 3)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				uint64_t a = point[m.index[t + k]], b = point[m.index[t + (k + 1) % 3]];
+				if (a == b) continue;
+				// The lowest bit tells the direction
+				edges.push_back(a < b ? (a << 33 | b << 1) : (b << 33 | a << 1 | 1));
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+
+		MeshReport report;
+		for (size_t i = 0; i < edges.size();)
+		{
+			size_t j = i;
+			unsigned uses[2] = { 0, 0 };
+			for (; j < edges.size() && (edges[j] >> 1) == (edges[i] >> 1); j++) uses[edges[j] & 1]++;
+			report.boundaryEdges += uses[0] > uses[1] ? uses[0] - uses[1] : uses[1] - uses[0];
+			if (uses[0] + uses[1] > 2) report.nonManifoldEdges++;
+			i = j;
+		}
+		return report;
+	}
+
+	// Reorder the triangles of 'm' so that they reuse the vertices of the
+	// triangles just before them, as in Tom Forsyth's "Linear-Speed Vertex
+	// Cache Optimisation": each step emits the triangle with the best score,
+	// which favours vertices in a simulated LRU cache of 'cacheSize'
+	// entries and vertices with few triangles left.
+	template<typename real>
+	void optimizeIndexOrder(ModelT<real>& m, unsigned cacheSize = 32)
+	{
+		const unsigned NONE = ~0u;
+		size_t triangles = m.index.size() / 3, vertices = m.vertices.size();
+		if (triangles == 0) return;
+		cacheSize = std::max(cacheSize, 4u);
+
+		auto vertexScore = [&](int cachePosition, unsigned remaining)
+		{
+			if (remaining == 0) return -1.f;
+			float score = 0.f;
+			if (cachePosition >= 3) score = powf(1.f - float(cachePosition - 3) / float(cacheSize - 3), 1.5f);
+			else if (cachePosition >= 0) score = 0.75f; // the last triangle, reusing it gains little
+			return score + 2.f / sqrtf((float)remaining);
+		};
+
+		// Triangles of each vertex that are not emitted yet, first[v]..first[v] + remaining[v]
+		std::vector<unsigned> first(vertices + 1, 0), remaining(vertices, 0), triangleOf(triangles * 3);
+		for (size_t i = 0; i < triangles * 3; i++) first[m.index[i] + 1]++;
+		for (size_t v = 0; v < vertices; v++) first[v + 1] += first[v];
+		for (size_t i = 0; i < triangles * 3; i++)
+		{
+			unsigned v = m.index[i];
+			triangleOf[first[v] + remaining[v]++] = (unsigned)(i / 3);
+		}
+
+		std::vector<int> cachePosition(vertices, -1);
+		std::vector<float> vertexScores(vertices), triangleScores(triangles, 0.f);
+		for (size_t v = 0; v < vertices; v++)
+		{
+			vertexScores[v] = vertexScore(-1, remaining[v]);
+			for (unsigned k = 0; k < remaining[v]; k++) triangleScores[triangleOf[first[v] + k]] += vertexScores[v];
+		}
+
+		std::vector<char> emitted(triangles, 0);
+		std::vector<unsigned> index, cache, newCache;
+		index.reserve(triangles * 3);
+		cache.reserve(cacheSize + 3);
+		newCache.reserve(cacheSize + 3);
+		unsigned best = 0, scan = 0;
+		for (size_t t = 0; t < triangles; t++)
+		{
+			if (best == NONE)
+			{
+				// Nothing in the cache has triangles left, continue with the
+				// next one in the input order
+				while (emitted[scan]) scan++;
+				best = scan;
+			}
+			emitted[best] = 1;
+			newCache.clear();
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned v = m.index[best * 3 + k];
+				index.push_back(v);
+				newCache.push_back(v);
+				unsigned* list = &triangleOf[first[v]];
+				unsigned at = (unsigned)(std::find(list, list + remaining[v], best) - list);
+				std::swap(list[at], list[--remaining[v]]);
+			}
+			for (unsigned v : cache)
+			{
+				if (v != newCache[0] && v != newCache[1] && v != newCache[2]) newCache.push_back(v);
+			}
+
+			// Rescore the vertices that moved in the cache or fell out of it,
+			// and their triangles
+			for (size_t k = 0; k < newCache.size(); k++)
+			{
+				unsigned v = newCache[k];
+				cachePosition[v] = k < cacheSize ? (int)k : -1;
+				float score = vertexScore(cachePosition[v], remaining[v]);
+				float delta = score - vertexScores[v];
+				vertexScores[v] = score;
+				for (unsigned j = 0; j < remaining[v]; j++) triangleScores[triangleOf[first[v] + j]] += delta;
+			}
+			if (newCache.size() > cacheSize) newCache.resize(cacheSize);
+
+			// Then pick the best triangle of the cached vertices, now that
+			// all their scores are up to date
+			best = NONE;
+			float bestScore = -1.f;
+			for (unsigned v : newCache)
+			{
+				for (unsigned j = 0; j < remaining[v]; j++)
+				{
+					unsigned tri = triangleOf[first[v] + j];
+					if (triangleScores[tri] > bestScore)
+					{
+						best = tri;
+						bestScore = triangleScores[tri];
+					}
+				}
+			}
+			std::swap(cache, newCache);
+		}
+		m.index.swap(index);
+	}
+
+	// Renumber the vertices of 'm' in the order the triangles first use
+	// them, so that drawing reads the vertex buffer front to back. Unused
+	// vertices move to the end.
+	template<typename real>
+	void optimizeVertexOrder(ModelT<real>& m)
+	{
+		const unsigned NONE = ~0u;
+		std::vector<unsigned> remap(m.vertices.size(), NONE);
+		std::vector< VertexT<real> > vertices;
+		vertices.reserve(m.vertices.size());
+		for (unsigned& vi : m.index)
+		{
+			if (remap[vi] == NONE)
+			{
+				remap[vi] = (unsigned)vertices.size();
+				vertices.push_back(m.vertices[vi]);
+			}
+			vi = remap[vi];
+		}
+		for (size_t v = 0; v < m.vertices.size(); v++)
+		{
+			if (remap[v] == NONE) vertices.push_back(m.vertices[v]);
+		}
+		m.vertices.swap(vertices);
+		m.rehash(2 * m.vertices.size());
+	}
+
+	// Average number of vertices per triangle that miss a FIFO vertex cache
+	// of 'cacheSize' entries, from 3 without reuse down to about 0.5
+	template<typename real>
+	real cacheMissRatio(const ModelT<real>& m, unsigned cacheSize = 32)
+	{
+		size_t triangles = m.index.size() / 3;
+		if (triangles == 0) return 0;
+		// A vertex is in the cache if fewer than cacheSize misses came after its own
+		std::vector<size_t> missed(m.vertices.size(), 0);
+		size_t misses = 0;
+		for (size_t i = 0; i < triangles * 3; i++)
+		{
+			unsigned v = m.index[i];
+			if (missed[v] == 0 || misses - missed[v] >= cacheSize) missed[v] = ++misses;
+		}
+		return real(misses) / triangles;
+	}
+
+	// Quality of a triangle, 1 for equilateral ones down to 0 for flat ones
+	template<typename real>
+	real triangleQuality(const tvec3<real>& a, const tvec3<real>& b, const tvec3<real>& c)
+	{
+		tvec3<real> ab = b - a, bc = c - b, ca = a - c;
+		real lengths = dot(ab, ab) + dot(bc, bc) + dot(ca, ca);
+		if (lengths <= 0) return 0;
+		return real(2 * 1.7320508075688772) * cross(ab, bc).length() / lengths;
+	}
+
+	// Triangulate the convex loop 'loop' of 'm' into m.index, without zero
+	// area triangles where vertices lie on straight sides
+	template<typename real>
+	void triangulateLoop(ModelT<real>& m, const std::vector<unsigned>& loop, const tvec3<real>& normal, real epsilon,
+		eTriangulation triangulation = TRIANGULATE_FAN)
+	{
+		typedef tvec3<real> vec3;
+		auto pos = [&](unsigned vi) -> const vec3& { return m.vertices[vi].pos; };
+		auto isCorner = [&](const std::vector<unsigned>& l, size_t k)
+		{
+			size_t n = l.size();
+			const vec3& prev = pos(l[(k + n - 1) % n]);
+			const vec3& cur = pos(l[k]);
+			const vec3& next = pos(l[(k + 1) % n]);
+			// Further than epsilon from the line through its neighbours
+			vec3 a = cur - prev, b = next - cur;
+			return dot(cross(a, b), normal) > epsilon * (a + b).length();
+		};
+		auto triangle = [&](unsigned a, unsigned b, unsigned c)
+		{
+			if (a == b || b == c || c == a) return;
+			m.index.push_back(a);
+			m.index.push_back(b);
+			m.index.push_back(c);
+		};
+		size_t n = loop.size();
+		auto corner = [&](size_t k) { return isCorner(loop, k); };
+
+		// Loops flatter than epsilon are left out. Their neighbours took
+		// their vertices in as T-junctions, so this closes the mesh.
+		size_t corners = 0;
+		for (size_t k = 0; k < n && corners < 3; k++) corners += corner(k);
+		if (corners < 3) return;
+
+		if (triangulation == TRIANGULATE_EAR_CLIP)
+		{
+			// Cut off the best shaped ear at a time. An ear is only cut if
+			// what is left is still a polygon, or the last triangle. The loop
+			// is convex, so every corner is an ear, and cutting one only
+			// changes whether its two neighbours are corners: each step
+			// scans the remaining vertices once.
+			std::vector<unsigned> prev(n), next(n);
+			std::vector<char> isEar(n);
+			corners = 0;
+			for (size_t k = 0; k < n; k++)
+			{
+				prev[k] = (unsigned)((k + n - 1) % n);
+				next[k] = (unsigned)((k + 1) % n);
+				isEar[k] = corner(k);
+				corners += isEar[k];
+			}
+			// Corner test of 'k' between the given neighbours
+			auto cornerBetween = [&](size_t p, size_t k, size_t q)
+			{
+				vec3 a = pos(loop[k]) - pos(loop[p]), b = pos(loop[q]) - pos(loop[k]);
+				return dot(cross(a, b), normal) > epsilon * (a + b).length();
+			};
+			size_t left = n, start = 0;
+			while (left > 3)
+			{
+				size_t best = n;
+				real bestQuality = -1;
+				size_t k = start;
+				for (size_t visited = 0; visited < left; visited++, k = next[k])
+				{
+					if (!isEar[k]) continue;
+					size_t p = prev[k], q = next[k];
+					real quality = triangleQuality(pos(loop[p]), pos(loop[k]), pos(loop[q]));
+					if (quality <= bestQuality) continue;
+					// Corners left after cutting k off
+					size_t after = corners - 1 - isEar[p] - isEar[q] + cornerBetween(prev[p], p, q) + cornerBetween(p, q, next[q]);
+					if (after < 3) continue;
+					best = k;
+					bestQuality = quality;
+				}
+				if (best == n) break;
+				size_t p = prev[best], q = next[best];
+				triangle(loop[p], loop[best], loop[q]);
+				corners -= 1 + isEar[p] + isEar[q];
+				next[p] = (unsigned)q;
+				prev[q] = (unsigned)p;
+				isEar[p] = cornerBetween(prev[p], p, q);
+				isEar[q] = cornerBetween(p, q, next[q]);
+				corners += isEar[p] + isEar[q];
+				start = q;
+				left--;
+			}
+			if (left == 3)
+			{
+				triangle(loop[prev[start]], loop[start], loop[next[start]]);
+				return;
+			}
+			// No ear leaves a polygon behind, fan the rest from its middle
+			// as below
+			std::vector<unsigned> rest;
+			size_t k = start;
+			for (size_t visited = 0; visited < left; visited++, k = next[k]) rest.push_back(loop[k]);
+			triangulateLoop(m, rest, normal, epsilon, TRIANGULATE_FAN);
+			return;
+		}
+
+		// A fan has no flat triangles if the neighbours of its apex are
+		// corners, since only the sides through the apex have flat ones.
+		// TRIANGULATE_BEST_FAN takes the apex whose worst triangle is best.
+		size_t apex = n;
+		real apexQuality = -1;
+		for (size_t j = 0; j < n; j++)
+		{
+			if (!corner((j + n - 1) % n) || !corner((j + 1) % n)) continue;
+			if (triangulation == TRIANGULATE_FAN)
+			{
+				apex = j;
+				break;
+			}
+			real worst = 1;
+			for (size_t k = 1; k + 1 < n && worst > apexQuality; k++)
+			{
+				worst = std::min(worst, triangleQuality(pos(loop[j]), pos(loop[(j + k) % n]), pos(loop[(j + k + 1) % n])));
+			}
+			if (worst > apexQuality)
+			{
+				apex = j;
+				apexQuality = worst;
+			}
+		}
+		if (apex < n)
+		{
+			for (size_t k = 1; k + 1 < n; k++) triangle(loop[apex], loop[(apex + k) % n], loop[(apex + k + 1) % n]);
+			return;
+		}
+
+		// Otherwise fan from the middle
+		VertexT<real> center;
+		center.normal = center.color = vec3(0.f);
+		for (unsigned vi : loop)
+		{
+			const VertexT<real>& v = m.vertices[vi];
+			center.pos = center.pos + v.pos;
+			center.normal = center.normal + v.normal;
+			center.color = center.color + v.color;
+			center.uv = center.uv + v.uv;
+		}
+		real scale = real(1) / n;
+		center.pos = center.pos * scale;
+		center.normal = center.normal * scale;
+		center.color = center.color * scale;
+		center.uv = center.uv * scale;
+		unsigned c = m.addVertex(center);
+		for (size_t k = 0; k < n; k++) triangle(c, loop[k], loop[(k + 1) % n]);
+	}
+
+	// As above, optionally repairing cracks and reporting on the result.
+	// The repair finds the vertices near each polygon edge through a grid
+	// of about the average edge length, so it stays linear in the size of
+	// the mesh.
+	template<typename real>
+	ModelT<real> fromPolygons(const VertexPoolT<real>& pool, const std::vector< PolygonT<real> >& polys, const MeshOptionsT<real>& options)
+	{
+		typedef tvec3<real> vec3;
+		typedef VertexT<real> Vertex;
+		auto finish = [&](ModelT<real>& m, unsigned tJunctions)
+		{
+			if (options.optimizeOrder)
+			{
+				optimizeIndexOrder(m, options.cacheSize);
+				optimizeVertexOrder(m);
+			}
+			if (options.report)
+			{
+				*options.report = checkWatertight(m);
+				options.report->tJunctions = tJunctions;
+			}
+		};
+		if (!options.repair)
+		{
+			ModelT<real> m;
+			if (options.triangulation == TRIANGULATE_FAN)
+			{
+				m = fromPolygons(pool, polys, (real)options.weldEpsilon);
+			}
+			else
+			{
+				m.weldEpsilon = options.weldEpsilon;
+				std::vector<unsigned> loop;
+				for (const PolygonT<real>& poly : polys)
+				{
+					loop.clear();
+					for (size_t i = 0; i < poly.vertices.size(); i++)
+					{
+						unsigned vi = m.addVertex(poly.vertex(pool, i));
+						if (loop.empty() || loop.back() != vi) loop.push_back(vi);
+					}
+					while (loop.size() > 1 && loop.back() == loop.front()) loop.pop_back();
+					if (loop.size() >= 3) triangulateLoop(m, loop, poly.plane.normal, real(0), options.triangulation);
+				}
+			}
+			finish(m, 0);
+			return m;
+		}
+		real eps = options.epsilon;
+
+		// Weld the positions alone, and give each polygon a loop of corners
+		// without repeated positions
+		ModelT<real> points(eps);
+		std::vector<unsigned> first(1, 0), corners;
+		std::vector<Vertex> cornerVertices;
+		real edgeLength = 0.f;
+		for (const PolygonT<real>& poly : polys)
+		{
+			size_t start = corners.size();
+			for (size_t i = 0; i < poly.vertices.size(); i++)
+			{
+				Vertex v = poly.vertex(pool, i);
+				unsigned pt = points.addVertex(Vertex(v.pos, vec3(0.f)));
+				if (corners.size() > start && corners.back() == pt) continue;
+				corners.push_back(pt);
+				cornerVertices.push_back(v);
+			}
+			while (corners.size() > start + 1 && corners.back() == corners[start])
+			{
+				corners.pop_back();
+				cornerVertices.pop_back();
+			}
+			if (corners.size() < start + 3)
+			{
+				corners.resize(start);
+				cornerVertices.resize(start);
+			}
+			for (size_t k = start; k < corners.size(); k++)
+			{
+				unsigned next = k + 1 < corners.size() ? corners[k + 1] : corners[start];
+				edgeLength += (points.vertices[next].pos - points.vertices[corners[k]].pos).length();
+			}
+			first.push_back((unsigned)corners.size());
+		}
+
+		// Grid of the positions, in chains like those of Model
+		const unsigned NONE = ~0u;
+		real cell = std::max(edgeLength / std::max<size_t>(corners.size(), 1), 4 * eps);
+		size_t bucketCount = 16;
+		while (bucketCount < 2 * points.vertices.size()) bucketCount *= 2;
+		std::vector<unsigned> buckets(bucketCount, NONE), chain(points.vertices.size());
+		auto cellOf = [&](real x) { return ModelT<real>::cellCoord(x, cell); };
+		auto bucketOf = [&](int64_t x, int64_t y, int64_t z) { return ModelT<real>::hashCell(x, y, z) & (unsigned)(bucketCount - 1); };
+		for (unsigned i = 0; i < (unsigned)points.vertices.size(); i++)
+		{
+			const vec3& p = points.vertices[i].pos;
+			unsigned h = bucketOf(cellOf(p.x), cellOf(p.y), cellOf(p.z));
+			chain[i] = buckets[h];
+			buckets[h] = i;
+		}
+
+		ModelT<real> m(options.weldEpsilon);
+		m.rehash(2 * corners.size());
+		unsigned tJunctions = 0;
+		// Positions near the edges of a polygon: distance squared, point, edge, and where on the edge
+		struct Found
+		{
+			real distance;
+			unsigned point, edge;
+			real t;
+		};
+		std::vector<Found> found;
+		std::vector<unsigned> loop;
+		for (size_t pi = 0; pi < polys.size(); pi++)
+		{
+			unsigned begin = first[pi], end = first[pi + 1];
+			if (begin == end) continue;
+
+			// Visit the cells along each edge a piece of at most one cell
+			// length at a time
+			found.clear();
+			for (unsigned k = begin; k < end; k++)
+			{
+				unsigned kn = k + 1 < end ? k + 1 : begin;
+				vec3 a = points.vertices[corners[k]].pos, d = points.vertices[corners[kn]].pos - a;
+				real length = d.length();
+				if (length <= 2 * eps) continue;
+				int pieces = (int)(length / cell) + 1;
+				for (int s = 0; s < pieces; s++)
+				{
+					vec3 p0 = a + d * (real(s) / pieces), p1 = a + d * (real(s + 1) / pieces);
+					int64_t x0 = cellOf(std::min(p0.x, p1.x) - eps), x1 = cellOf(std::max(p0.x, p1.x) + eps);
+					int64_t y0 = cellOf(std::min(p0.y, p1.y) - eps), y1 = cellOf(std::max(p0.y, p1.y) + eps);
+					int64_t z0 = cellOf(std::min(p0.z, p1.z) - eps), z1 = cellOf(std::max(p0.z, p1.z) + eps);
+					for (int64_t z = z0; z <= z1; z++)
+					for (int64_t y = y0; y <= y1; y++)
+					for (int64_t x = x0; x <= x1; x++)
+					{
+						for (unsigned i = buckets[bucketOf(x, y, z)]; i != NONE; i = chain[i])
+						{
+							vec3 ap = points.vertices[i].pos - a;
+							real t = dot(ap, d) / (length * length);
+							if (t * length <= eps || (1 - t) * length <= eps) continue;
+							vec3 off = ap - d * t;
+							if (dot(off, off) <= eps * eps) found.push_back(Found{ dot(off, off), i, k, t });
+						}
+					}
+				}
+			}
+
+			// Each position goes on the nearest edge only, and not at all if
+			// it is a corner of the polygon already
+			std::sort(found.begin(), found.end(), [](const Found& a, const Found& b)
+			{
+				return a.point != b.point ? a.point < b.point : a.distance < b.distance;
+			});
+			size_t kept = 0;
+			for (size_t f = 0; f < found.size(); f++)
+			{
+				if (kept > 0 && found[kept - 1].point == found[f].point) continue;
+				if (std::find(corners.begin() + begin, corners.begin() + end, found[f].point) != corners.begin() + end) continue;
+				found[kept++] = found[f];
+			}
+			found.resize(kept);
+			std::sort(found.begin(), found.end(), [](const Found& a, const Found& b)
+			{
+				return a.edge != b.edge ? a.edge < b.edge : a.t < b.t;
+			});
+
+			loop.clear();
+			size_t f = 0;
+			for (unsigned k = begin; k < end; k++)
+			{
+				unsigned kn = k + 1 < end ? k + 1 : begin;
+				Vertex va = cornerVertices[k];
+				va.pos = points.vertices[corners[k]].pos;
+				loop.push_back(m.addVertex(va));
+				for (; f < found.size() && found[f].edge == k; f++)
+				{
+					Vertex v = cornerVertices[k].interpolate(cornerVertices[kn], found[f].t);
+					v.pos = points.vertices[found[f].point].pos;
+					loop.push_back(m.addVertex(v));
+					tJunctions++;
+				}
+			}
+			triangulateLoop(m, loop, polys[pi].plane.normal, (real)eps, options.triangulation);
+		}
+		finish(m, tJunctions);
+		return m;
+	}
+
+	template<typename real>
+	ModelT<real> fromPolygons(const CSGT<real>& csg, const MeshOptionsT<real>& options)
+	{
+		return fromPolygons(csg.pool, csg.polygons, options);
+	}
+
+	template<typename real>
+	void stats(CSGT<real> &o)
 	{
 		int vertex_count  = 0;
-		for (Polygon& p : o.polygons)
+		for (PolygonT<real>& p : o.polygons)
 		{
 			vertex_count  += (int)p.vertices.size();
 			//vec3 n = p.plane.normal;
@@ -674,4 +4280,79 @@ void splitPolygon(
 		printf("CSG object polys: %d, vertices:%d \n", (int)o.polygons.size(), vertex_count);
 	}
 
+	typedef VertexT<real> Vertex;
+	typedef PlaneT<real> Plane;
+	typedef VertexPoolT<real> VertexPool;
+	typedef AABBT<real> AABB;
+	typedef PolygonT<real> Polygon;
+	typedef BSPNodeT<real> BSPNode;
+	typedef NodeArenaT<real> NodeArena;
+	typedef NodeT<real> Node;
+	typedef CSGT<real> CSG;
+	typedef ModelT<real> Model;
+	typedef OptionsT<real> Options;
+	typedef MeshOptionsT<real> MeshOptions;
+
+	typedef VertexT<double> Vertexd;
+	typedef PlaneT<double> Planed;
+	typedef VertexPoolT<double> VertexPoold;
+	typedef AABBT<double> AABBd;
+	typedef PolygonT<double> Polygond;
+	typedef BSPNodeT<double> BSPNoded;
+	typedef NodeArenaT<double> NodeArenad;
+	typedef NodeT<double> Noded;
+	typedef CSGT<double> CSGd;
+	typedef ModelT<double> Modeld;
+	typedef OptionsT<double> Optionsd;
+	typedef MeshOptionsT<double> MeshOptionsd;
+
+#if defined(CSGHPP_IMPLEMENTATION)
+	// Compiles every member for both scalar types, see csg.cpp. Define
+	// CSGHPP_IMPLEMENTATION in at most one translation unit.
+	template struct VertexT<float>;
+	template struct PlaneT<float>;
+	template struct VertexPoolT<float>;
+	template struct AABBT<float>;
+	template struct PolygonT<float>;
+	template struct BSPNodeT<float>;
+	template struct NodeArenaT<float>;
+	template struct NodeT<float>;
+	template struct CSGT<float>;
+	template struct ModelT<float>;
+
+	template struct VertexT<double>;
+	template struct PlaneT<double>;
+	template struct VertexPoolT<double>;
+	template struct AABBT<double>;
+	template struct PolygonT<double>;
+	template struct BSPNodeT<double>;
+	template struct NodeArenaT<double>;
+	template struct NodeT<double>;
+	template struct CSGT<double>;
+	template struct ModelT<double>;
+#elif defined(CSGHPP_SEPARATE_COMPILATION)
+	// Compiled by csg.cpp; other scalar types need the header only mode
+	extern template struct VertexT<float>;
+	extern template struct PlaneT<float>;
+	extern template struct VertexPoolT<float>;
+	extern template struct AABBT<float>;
+	extern template struct PolygonT<float>;
+	extern template struct BSPNodeT<float>;
+	extern template struct NodeArenaT<float>;
+	extern template struct NodeT<float>;
+	extern template struct CSGT<float>;
+	extern template struct ModelT<float>;
+
+	extern template struct VertexT<double>;
+	extern template struct PlaneT<double>;
+	extern template struct VertexPoolT<double>;
+	extern template struct AABBT<double>;
+	extern template struct PolygonT<double>;
+	extern template struct BSPNodeT<double>;
+	extern template struct NodeArenaT<double>;
+	extern template struct NodeT<double>;
+	extern template struct CSGT<double>;
+	extern template struct ModelT<double>;
+#endif
+
 }; // CSG namespace
\ No newline at end of file
@@ -0,0 +1,410 @@
+#pragma once
+
+#include <stdint.h>
+#include <unordered_map>
+
+#include "csg.hpp"
+
+// Lazily evaluated CSG expressions, see CSGExpr.
+
+namespace csghpp
+{
+	template<typename real>
+	struct ExprNodeT
+	{
+		typedef tvec3<real> vec3;
+		typedef CSGT<real> CSG;
+
+		// One node of a CSGExpr DAG: a primitive with its parameters, a given
+		// CSG, or a boolean operation of two other nodes.
+		// 'result' is what the node evaluated to last time. It is reused as
+		// long as the node is still what 'resultKey' recorded, and its
+		// children still evaluate to the results it was computed from.
+		enum eKind { CONSTANT, CUBE, SPHERE, CYLINDER, UNION, SUBTRACT, INTERSECT };
+
+		ExprNodeT(eKind _kind)
+			: kind(_kind)
+			, constantId(0)
+			, colored(false)
+		{
+		}
+
+		bool isOp() const { return kind >= UNION; }
+
+		// What a node was when 'result' was computed
+		struct Key
+		{
+			eKind kind;
+			std::vector<real> params;
+			uint64_t constantId;
+			bool colored;
+			vec3 color;
+			std::weak_ptr<const CSG> a, b; // the results of the children used
+		};
+
+		// Same kind, parameters, constant and color. Children are compared
+		// by the caller.
+		template<typename A, typename B>
+		static bool sameFields(const A& x, const B& y)
+		{
+			return x.kind == y.kind && x.params == y.params && x.constantId == y.constantId && x.colored == y.colored &&
+				(!x.colored || (x.color.x == y.color.x && x.color.y == y.color.y && x.color.z == y.color.z));
+		}
+
+		eKind kind;
+		std::vector<real> params; // of primitives, as passed to CSG::cube etc.
+		std::shared_ptr<const CSG> constant;
+		uint64_t constantId;      // tells constants apart, as they are not hashed
+		std::shared_ptr<ExprNodeT> a, b;
+		bool colored;             // setColor() was called on the node
+		vec3 color;
+		std::shared_ptr<const CSG> result;
+		std::unique_ptr<Key> resultKey;
+	};
+
+	template<typename real>
+	struct CSGExprT
+	{
+		typedef tvec3<real> vec3;
+		typedef CSGT<real> CSG;
+		typedef OptionsT<real> Options;
+		typedef ExprNodeT<real> ExprNode;
+
+		// Records primitives and boolean operations instead of evaluating them.
+		// evaluate() computes the result, keeping the result of every node so
+		// that evaluating again after changing a leaf with set() or setColor()
+		// only recomputes the nodes on the paths from the changed leaves to the
+		// root. Equal subtrees, whether shared or built twice, are found
+		// through a hash of their subtree and compared node by node, and are
+		// only evaluated once. Nodes of the same height do not depend on each
+		// other and are evaluated in parallel with options.threads.
+		// An expression must not be changed while it is being evaluated.
+		// evaluate() stores the results in the nodes, so expressions that
+		// share nodes must not be evaluated at the same time either.
+		// CSGExpr evaluates to a CSG, CSGExprd to a CSGd.
+		CSGExprT()
+			: node(std::make_shared<ExprNode>(ExprNode::CONSTANT))
+		{
+			node->constant = std::make_shared<const CSG>();
+			node->constantId = nextConstantId();
+		}
+
+		static CSGExprT constant(CSG csg)
+		{
+			CSGExprT e;
+			e.node->constant = std::make_shared<const CSG>(std::move(csg));
+			return e;
+		}
+
+		static CSGExprT cube(vec3 c = vec3(0.f), vec3 radius = 1.0f)
+		{
+			return primitive(ExprNode::CUBE, { c.x, c.y, c.z, radius.x, radius.y, radius.z });
+		}
+
+		static CSGExprT sphere(vec3 center = vec3(0.f), real radius = 1.f, int stacks = 8, int slices = 16)
+		{
+			return primitive(ExprNode::SPHERE, { center.x, center.y, center.z, radius, real(stacks), real(slices) });
+		}
+
+		static CSGExprT cylinder(real radius = 1.f, vec3 start = vec3(0.f, -1.f, 0.f), vec3 end = vec3(0.f, 1.f, 0.f), int slices = 16)
+		{
+			return primitive(ExprNode::CYLINDER, { radius, start.x, start.y, start.z, end.x, end.y, end.z, real(slices) });
+		}
+
+		CSGExprT unionOp(const CSGExprT& other) const { return op(ExprNode::UNION, other); }
+		CSGExprT subOp(const CSGExprT& other) const { return op(ExprNode::SUBTRACT, other); }
+		CSGExprT intersectOp(const CSGExprT& other) const { return op(ExprNode::INTERSECT, other); }
+
+		// Color all vertices of the result of this node
+		CSGExprT& setColor(float r, float g, float b)
+		{
+			node->colored = true;
+			node->color = vec3(r, g, b);
+			return *this;
+		}
+
+		// Make this node compute what 'other' computes. Every expression using
+		// this node sees the change. 'other' must not use this node.
+		void set(const CSGExprT& other)
+		{
+			assert(!other.uses(node.get()) && "expression would contain itself");
+			ExprNode& n = *node;
+			const ExprNode& o = *other.node;
+			n.kind = o.kind;
+			n.params = o.params;
+			n.constant = o.constant;
+			n.constantId = o.constantId;
+			n.a = o.a;
+			n.b = o.b;
+			n.colored = o.colored;
+			n.color = o.color;
+		}
+
+		// Evaluate the expression, reusing the results of unchanged nodes
+		std::shared_ptr<const CSG> evaluate(const Options& options = Options::defaults()) const
+		{
+			// Visit all nodes, children first. Each node is represented by the
+			// first node equal to it, found by hash and then compared field by
+			// field, with its children compared by their representatives.
+			std::unordered_map<const ExprNode*, uint64_t> hashes;
+			std::unordered_map<const ExprNode*, const ExprNode*> rep;
+			std::unordered_multimap<uint64_t, const ExprNode*> reps;
+			// Results by representative, those still valid first
+			std::unordered_map<const ExprNode*, std::shared_ptr<const CSG> > results;
+			std::vector<ExprNode*> order; // children before parents
+			std::vector< std::pair<ExprNode*, bool> > stack; // node, children done
+			stack.push_back(std::make_pair(node.get(), false));
+			while (stack.empty() == false)
+			{
+				ExprNode* n = stack.back().first;
+				bool childrenDone = stack.back().second;
+				stack.pop_back();
+				if (hashes.count(n)) continue;
+				if (n->isOp() && !childrenDone)
+				{
+					stack.push_back(std::make_pair(n, true));
+					stack.push_back(std::make_pair(n->b.get(), false));
+					stack.push_back(std::make_pair(n->a.get(), false));
+					continue;
+				}
+				uint64_t h = hash(*n, hashes);
+				hashes[n] = h;
+				order.push_back(n);
+
+				const ExprNode* r = n;
+				auto range = reps.equal_range(h);
+				for (auto it = range.first; it != range.second; ++it)
+				{
+					const ExprNode& c = *it->second;
+					if (ExprNode::sameFields(*n, c) && (!n->isOp() || (rep.at(n->a.get()) == rep.at(c.a.get()) && rep.at(n->b.get()) == rep.at(c.b.get()))))
+					{
+						r = &c;
+						break;
+					}
+				}
+				rep[n] = r;
+				if (r == n) reps.insert(std::make_pair(h, r));
+				if (results.count(r)) continue;
+				if (n->kind == ExprNode::CONSTANT && !n->colored) results[r] = n->constant;
+				else if (isValid(*n, rep, results)) results[r] = n->result;
+			}
+
+			// Find the nodes to evaluate, one per representative, and sort
+			// them by height above the nodes whose results are known
+			std::unordered_map<const ExprNode*, unsigned> heights;
+			std::vector< std::vector<const ExprNode*> > levels;
+			for (ExprNode* n : order)
+			{
+				const ExprNode* r = rep[n];
+				if (results.count(r) || heights.count(r)) continue;
+				unsigned height = 0;
+				if (n->isOp())
+				{
+					for (const ExprNode* child : { n->a.get(), n->b.get() })
+					{
+						auto it = heights.find(rep[child]);
+						if (it != heights.end()) height = std::max(height, it->second + 1);
+					}
+				}
+				heights[r] = height;
+				if (levels.size() <= height) levels.resize(height + 1);
+				levels[height].push_back(r);
+			}
+
+			const ExprNode* root = rep[node.get()];
+			for (const std::vector<const ExprNode*>& level : levels)
+			{
+				std::vector< std::shared_ptr<const CSG> > computed(level.size());
+				auto evaluateNode = [&](size_t i)
+				{
+					const ExprNode& n = *level[i];
+					CSG csg = n.isOp()
+						? apply(n.kind, *results.at(rep.at(n.a.get())), *results.at(rep.at(n.b.get())), options)
+						: generate(n);
+					if (n.colored) csg.setColor(n.color.x, n.color.y, n.color.z);
+					// Operands keep their tree, so that an operation redone after
+					// an edit of its other operand does not need to build it again
+					if (level[i] != root) csg.tree();
+					computed[i] = std::make_shared<const CSG>(std::move(csg));
+				};
+				if (options.threads && level.size() > 1)
+				{
+					TaskGroup group(*options.threads);
+					for (size_t i = 1; i < level.size(); i++)
+					{
+						group.run([&evaluateNode, i]() { evaluateNode(i); });
+					}
+					evaluateNode(0);
+					group.wait();
+				}
+				else
+				{
+					for (size_t i = 0; i < level.size(); i++) evaluateNode(i);
+				}
+				for (size_t i = 0; i < level.size(); i++)
+				{
+					results[level[i]] = computed[i];
+				}
+			}
+
+			for (ExprNode* n : order)
+			{
+				std::shared_ptr<const CSG> result = results.at(rep[n]);
+				if (n->result == result && n->resultKey) continue;
+				n->result = result;
+				n->resultKey.reset(new typename ExprNode::Key());
+				typename ExprNode::Key& k = *n->resultKey;
+				k.kind = n->kind;
+				k.params = n->params;
+				k.constantId = n->constantId;
+				k.colored = n->colored;
+				k.color = n->color;
+				if (n->isOp())
+				{
+					k.a = results.at(rep[n->a.get()]);
+					k.b = results.at(rep[n->b.get()]);
+				}
+			}
+			return node->result;
+		}
+
+		// True if the result kept in 'n' is still its result: the node is
+		// unchanged, and its children's results are the ones it was computed
+		// from
+		static bool isValid(const ExprNode& n, const std::unordered_map<const ExprNode*, const ExprNode*>& rep,
+			const std::unordered_map<const ExprNode*, std::shared_ptr<const CSG> >& results)
+		{
+			if (!n.result || !n.resultKey || !ExprNode::sameFields(n, *n.resultKey)) return false;
+			if (!n.isOp()) return true;
+			auto same = [&](const ExprNode* child, const std::weak_ptr<const CSG>& used)
+			{
+				auto it = results.find(rep.at(child));
+				return it != results.end() && !used.owner_before(it->second) && !it->second.owner_before(used);
+			};
+			return same(n.a.get(), n.resultKey->a) && same(n.b.get(), n.resultKey->b);
+		}
+
+		// Drop the results kept for later evaluations
+		void clearResults()
+		{
+			std::vector<ExprNode*> nodes;
+			nodes.push_back(node.get());
+			while (nodes.empty() == false)
+			{
+				ExprNode* n = nodes.back();
+				nodes.pop_back();
+				n->result.reset();
+				n->resultKey.reset();
+				if (n->isOp())
+				{
+					nodes.push_back(n->a.get());
+					nodes.push_back(n->b.get());
+				}
+			}
+		}
+
+		static CSGExprT primitive(typename ExprNode::eKind kind, std::vector<real> params)
+		{
+			CSGExprT e;
+			e.node = std::make_shared<ExprNode>(kind);
+			e.node->params = std::move(params);
+			return e;
+		}
+
+		CSGExprT op(typename ExprNode::eKind kind, const CSGExprT& other) const
+		{
+			CSGExprT e;
+			e.node = std::make_shared<ExprNode>(kind);
+			e.node->a = node;
+			e.node->b = other.node;
+			return e;
+		}
+
+		// True if 'n' is part of this expression
+		bool uses(const ExprNode* n) const
+		{
+			std::vector<const ExprNode*> nodes;
+			nodes.push_back(node.get());
+			while (nodes.empty() == false)
+			{
+				const ExprNode* m = nodes.back();
+				nodes.pop_back();
+				if (m == n) return true;
+				if (m->isOp())
+				{
+					nodes.push_back(m->a.get());
+					nodes.push_back(m->b.get());
+				}
+			}
+			return false;
+		}
+
+		static uint64_t nextConstantId()
+		{
+			static std::atomic<uint64_t> id(0);
+			return ++id;
+		}
+
+		static uint64_t combine(uint64_t h, uint64_t v)
+		{
+			return h ^ (v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2));
+		}
+
+		static uint64_t combine(uint64_t h, real v)
+		{
+			// The bits of a double, which holds floats and doubles exactly
+			double d = v;
+			uint64_t bits;
+			memcpy(&bits, &d, sizeof(bits));
+			return combine(h, bits);
+		}
+
+		// Hash of the subtree of 'n', whose children are in 'hashes' already
+		static uint64_t hash(const ExprNode& n, const std::unordered_map<const ExprNode*, uint64_t>& hashes)
+		{
+			uint64_t h = combine(0ull, uint64_t(n.kind));
+			for (real p : n.params) h = combine(h, p);
+			if (n.kind == ExprNode::CONSTANT) h = combine(h, n.constantId);
+			if (n.isOp())
+			{
+				h = combine(h, hashes.at(n.a.get()));
+				h = combine(h, hashes.at(n.b.get()));
+			}
+			if (n.colored)
+			{
+				h = combine(h, n.color.x);
+				h = combine(h, n.color.y);
+				h = combine(h, n.color.z);
+			}
+			return h;
+		}
+
+		static CSG generate(const ExprNode& n)
+		{
+			const std::vector<real>& p = n.params;
+			switch (n.kind)
+			{
+			case ExprNode::CUBE: return CSG::cube(vec3(p[0], p[1], p[2]), vec3(p[3], p[4], p[5]));
+			case ExprNode::SPHERE: return CSG::sphere(vec3(p[0], p[1], p[2]), p[3], int(p[4]), int(p[5]));
+			case ExprNode::CYLINDER: return CSG::cylinder(p[0], vec3(p[1], p[2], p[3]), vec3(p[4], p[5], p[6]), int(p[7]));
+			default: return *n.constant;
+			}
+		}
+
+		static CSG apply(typename ExprNode::eKind kind, const CSG& a, const CSG& b, const Options& options)
+		{
+			if (kind == ExprNode::UNION) return a.unionOp(b, options);
+			if (kind == ExprNode::SUBTRACT) return a.subOp(b, options);
+			return a.intersectOp(b, options);
+		}
+
+		std::shared_ptr<ExprNode> node;
+	};
+
+	typedef ExprNodeT<real> ExprNode;
+	typedef CSGExprT<real> CSGExpr;
+
+	typedef ExprNodeT<double> ExprNoded;
+	typedef CSGExprT<double> CSGExprd;
+
+} // namespace csghpp
@@ -0,0 +1,1271 @@
+#pragma once
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+
+#include "csg.hpp"
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Binary STL and PLY files. The readers map the file into memory and parse
+// it straight into the vertex pool and polygons of a CSG; the writers stream
+// a CSG or Model to the file through a small buffer.
+// All functions return false on failure and describe it in 'error', if given.
+
+namespace csghpp
+{
+	struct MappedFile
+	{
+		// Read only view of a whole file
+		MappedFile()
+			: data(nullptr)
+			, size(0)
+#if defined(_WIN32)
+			, file(INVALID_HANDLE_VALUE)
+			, mapping(nullptr)
+#endif
+		{
+		}
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		~MappedFile()
+		{
+			close();
+		}
+
+		bool open(const char* path)
+		{
+			close();
+#if defined(_WIN32)
+			file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+			if (file == INVALID_HANDLE_VALUE) return false;
+			LARGE_INTEGER length;
+			if (!GetFileSizeEx(file, &length)) { close(); return false; }
+			size = (size_t)length.QuadPart;
+			if (size == 0) return true;
+			mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (!mapping) { close(); return false; }
+			data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			if (!data) { close(); return false; }
+#else
+			int fd = ::open(path, O_RDONLY);
+			if (fd < 0) return false;
+			struct stat st;
+			if (fstat(fd, &st) != 0) { ::close(fd); return false; }
+			size = (size_t)st.st_size;
+			if (size > 0)
+			{
+				void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (p == MAP_FAILED) p = nullptr;
+				else madvise(p, size, MADV_SEQUENTIAL);
+				data = (const unsigned char*)p;
+			}
+			::close(fd); // the mapping stays valid
+			if (size > 0 && !data) { size = 0; return false; }
+#endif
+			return true;
+		}
+
+		void close()
+		{
+#if defined(_WIN32)
+			if (data) UnmapViewOfFile(data);
+			if (mapping) CloseHandle(mapping);
+			if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+			mapping = nullptr;
+			file = INVALID_HANDLE_VALUE;
+#else
+			if (data) munmap((void*)data, size);
+#endif
+			data = nullptr;
+			size = 0;
+		}
+
+		const unsigned char* data;
+		size_t size;
+#if defined(_WIN32)
+		HANDLE file;
+		HANDLE mapping;
+#endif
+	};
+
+	struct FileWriter
+	{
+		// Buffered output for the streaming writers. Multi-byte values are
+		// written little endian.
+		FileWriter()
+			: file(nullptr)
+			, used(0)
+			, offset(0)
+			, failed(false)
+			, swap(hostIsBigEndian())
+		{
+		}
+
+		FileWriter(const FileWriter&) = delete;
+		FileWriter& operator=(const FileWriter&) = delete;
+
+		~FileWriter()
+		{
+			close();
+		}
+
+		static bool hostIsBigEndian()
+		{
+			const uint16_t one = 1;
+			unsigned char first;
+			memcpy(&first, &one, 1);
+			return first == 0;
+		}
+
+		bool open(const char* path)
+		{
+			file = fopen(path, "wb");
+			buffer.resize(1 << 16);
+			used = 0;
+			offset = 0;
+			failed = false;
+			return file != nullptr;
+		}
+
+		void write(const void* data, size_t n)
+		{
+			offset += n;
+			if (used + n > buffer.size()) flush();
+			if (n > buffer.size())
+			{
+				failed |= fwrite(data, 1, n, file) != n;
+				return;
+			}
+			memcpy(&buffer[used], data, n);
+			used += n;
+		}
+
+		void write(const std::string& text)
+		{
+			write(text.data(), text.size());
+		}
+
+		// Write zeros up to the next multiple of 'alignment'
+		void align(size_t alignment)
+		{
+			static const unsigned char zeros[16] = {};
+			while (offset % alignment) write(zeros, std::min(alignment - offset % alignment, sizeof(zeros)));
+		}
+
+		template<typename T>
+		void put(T v)
+		{
+			unsigned char bytes[sizeof(T)];
+			memcpy(bytes, &v, sizeof(T));
+			if (swap) std::reverse(bytes, bytes + sizeof(T));
+			write(bytes, sizeof(T));
+		}
+
+		void flush()
+		{
+			if (used == 0) return;
+			failed |= fwrite(buffer.data(), 1, used, file) != used;
+			used = 0;
+		}
+
+		// Returns false if anything could not be written
+		bool close()
+		{
+			if (!file) return !failed;
+			flush();
+			failed |= fclose(file) != 0;
+			file = nullptr;
+			return !failed;
+		}
+
+		FILE* file;
+		std::vector<unsigned char> buffer;
+		size_t used;
+		size_t offset; // bytes written since open()
+		bool failed;
+		bool swap;
+	};
+
+	// Value of type T stored at 'p', with its bytes reversed if 'swap'
+	template<typename T>
+	T loadBytes(const unsigned char* p, bool swap)
+	{
+		unsigned char bytes[sizeof(T)];
+		memcpy(bytes, p, sizeof(T));
+		if (swap) std::reverse(bytes, bytes + sizeof(T));
+		T v;
+		memcpy(&v, bytes, sizeof(T));
+		return v;
+	}
+
+	inline bool ioError(std::string* error, const std::string& message)
+	{
+		if (error) *error = message;
+		return false;
+	}
+
+	// Add the face with the vertices 'indices' of csg.pool to csg.polygons.
+	// Polygons must be convex and planar, so faces whose vertices are not
+	// within defaultEpsilon() of their plane are added as a fan of triangles.
+	// Degenerate faces and triangles are dropped.
+	template<typename real>
+	void addMeshFace(CSGT<real>& csg, IndexList& indices)
+	{
+		typedef tvec3<real> vec3;
+		const VertexPoolT<real>& pool = csg.pool;
+		unsigned n = indices.size();
+		if (n < 3) return;
+		if (n == 3)
+		{
+			PlaneT<real> plane = PlaneT<real>::fromPoints(pool.pos(indices[0]), pool.pos(indices[1]), pool.pos(indices[2]));
+			if (plane.ok()) csg.polygons.push_back(PolygonT<real>(indices, plane));
+			return;
+		}
+
+		// Newell's normal, which uses all vertices
+		vec3 normal(0.f), center(0.f);
+		for (unsigned i = 0; i < n; i++)
+		{
+			vec3 p = pool.pos(indices[i]);
+			vec3 q = pool.pos(indices[(i + 1) % n]);
+			normal.x += (p.y - q.y) * (p.z + q.z);
+			normal.y += (p.z - q.z) * (p.x + q.x);
+			normal.z += (p.x - q.x) * (p.y + q.y);
+			center = center + p;
+		}
+		if (normal.length() > 0.f)
+		{
+			normal = normal.unit();
+			PlaneT<real> plane(normal, dot(normal, center / real(n)));
+			bool planar = true;
+			for (unsigned vi : indices)
+			{
+				if (fabs(dot(normal, pool.pos(vi)) - plane.w) > defaultEpsilon<real>()) planar = false;
+			}
+			if (planar)
+			{
+				csg.polygons.push_back(PolygonT<real>(indices, plane));
+				return;
+			}
+		}
+		for (unsigned i = 2; i < n; i++)
+		{
+			IndexList triangle = { indices[0], indices[i - 1], indices[i] };
+			addMeshFace(csg, triangle);
+		}
+	}
+
+	// Read binary STL from memory. Every triangle gets vertices of its own,
+	// with its normal; the pool of 'csg' only stores normals.
+	template<typename real>
+	bool parseSTL(const void* data, size_t size, CSGT<real>& csg, std::string* error = nullptr)
+	{
+		typedef tvec3<real> vec3;
+		const unsigned char* bytes = (const unsigned char*)data;
+		bool swap = FileWriter::hostIsBigEndian();
+		uint32_t count = size >= 84 ? loadBytes<uint32_t>(bytes + 80, swap) : 0;
+		if (size < 84 || (size - 84) / 50 < count)
+		{
+			// ASCII files start with "solid", but some binary ones do as well
+			if (size >= 5 && memcmp(bytes, "solid", 5) == 0) return ioError(error, "ASCII STL is not supported");
+			return ioError(error, "STL file is truncated");
+		}
+
+		csg = CSGT<real>(VertexPoolT<real>(ATTR_NORMAL), std::vector< PolygonT<real> >());
+		csg.polygons.reserve(count);
+		const unsigned char* p = bytes + 84;
+		for (uint32_t i = 0; i < count; i++, p += 50)
+		{
+			// The stored normal is often missing or wrong, so it is computed
+			vec3 v[3];
+			for (int k = 0; k < 3; k++)
+			{
+				const unsigned char* q = p + 12 + 12 * k;
+				v[k] = vec3(loadBytes<float>(q, swap), loadBytes<float>(q + 4, swap), loadBytes<float>(q + 8, swap));
+			}
+			PlaneT<real> plane = PlaneT<real>::fromPoints(v[0], v[1], v[2]);
+			if (!plane.ok()) continue;
+			IndexList indices;
+			for (int k = 0; k < 3; k++)
+			{
+				indices.push_back(csg.pool.add(VertexT<real>(v[k], plane.normal)));
+			}
+			csg.polygons.push_back(PolygonT<real>(std::move(indices), plane));
+		}
+		csg.invalidate();
+		return true;
+	}
+
+	template<typename real>
+	bool readSTL(const char* path, CSGT<real>& csg, std::string* error = nullptr)
+	{
+		MappedFile file;
+		if (!file.open(path)) return ioError(error, std::string("cannot open ") + path);
+		return parseSTL(file.data, file.size, csg, error);
+	}
+
+	struct PlyProperty
+	{
+		// Property of a PLY element; list properties have a count type
+		enum eType { NONE, INT8, UINT8, INT16, UINT16, INT32, UINT32, FLOAT32, FLOAT64 };
+
+		static eType typeOf(const std::string& name)
+		{
+			if (name == "char" || name == "int8") return INT8;
+			if (name == "uchar" || name == "uint8") return UINT8;
+			if (name == "short" || name == "int16") return INT16;
+			if (name == "ushort" || name == "uint16") return UINT16;
+			if (name == "int" || name == "int32") return INT32;
+			if (name == "uint" || name == "uint32") return UINT32;
+			if (name == "float" || name == "float32") return FLOAT32;
+			if (name == "double" || name == "float64") return FLOAT64;
+			return NONE;
+		}
+
+		static size_t sizeOf(eType type)
+		{
+			static const size_t sizes[] = { 0, 1, 1, 2, 2, 4, 4, 4, 8 };
+			return sizes[type];
+		}
+
+		static double load(const unsigned char* p, eType type, bool swap)
+		{
+			switch (type)
+			{
+			case INT8: return (double)(int8_t)p[0];
+			case UINT8: return (double)p[0];
+			case INT16: return (double)loadBytes<int16_t>(p, swap);
+			case UINT16: return (double)loadBytes<uint16_t>(p, swap);
+			case INT32: return (double)loadBytes<int32_t>(p, swap);
+			case UINT32: return (double)loadBytes<uint32_t>(p, swap);
+			case FLOAT32: return (double)loadBytes<float>(p, swap);
+			case FLOAT64: return loadBytes<double>(p, swap);
+			default: return 0.0;
+			}
+		}
+
+		std::string name;
+		eType type;
+		eType countType; // NONE for scalar properties
+	};
+
+	struct PlyElement
+	{
+		// Bytes per element, 0 if it has list properties
+		size_t stride() const
+		{
+			size_t bytes = 0;
+			for (const PlyProperty& p : properties)
+			{
+				if (p.countType != PlyProperty::NONE) return 0;
+				bytes += PlyProperty::sizeOf(p.type);
+			}
+			return bytes;
+		}
+
+		// Byte offset of scalar property 'name', or -1
+		long offsetOf(const std::string& name) const
+		{
+			long offset = 0;
+			for (const PlyProperty& p : properties)
+			{
+				if (p.name == name && p.countType == PlyProperty::NONE) return offset;
+				offset += (long)PlyProperty::sizeOf(p.type);
+			}
+			return -1;
+		}
+
+		const PlyProperty* find(const std::string& name) const
+		{
+			for (const PlyProperty& p : properties)
+			{
+				if (p.name == name) return &p;
+			}
+			return nullptr;
+		}
+
+		// Move 'p' past one element, or return false if it does not fit before 'end'
+		bool skip(const unsigned char*& p, const unsigned char* end, bool swap) const
+		{
+			for (const PlyProperty& prop : properties)
+			{
+				size_t bytes = PlyProperty::sizeOf(prop.type);
+				if (prop.countType != PlyProperty::NONE)
+				{
+					size_t countBytes = PlyProperty::sizeOf(prop.countType);
+					if ((size_t)(end - p) < countBytes) return false;
+					bytes *= (size_t)PlyProperty::load(p, prop.countType, swap);
+					p += countBytes;
+				}
+				if ((size_t)(end - p) < bytes) return false;
+				p += bytes;
+			}
+			return true;
+		}
+
+		std::string name;
+		size_t count;
+		std::vector<PlyProperty> properties;
+	};
+
+	// Read binary PLY from memory. Vertices are shared by faces as in the
+	// file. The pool of 'csg' gets the attributes the file has: normals
+	// (nx, ny, nz), colors (red, green, blue), UVs (u, v or s, t) and user
+	// attributes user0, user1 etc., as written by writePLY.
+	template<typename real>
+	bool parsePLY(const void* data, size_t size, CSGT<real>& csg, std::string* error = nullptr)
+	{
+		typedef tvec3<real> vec3;
+		const unsigned char* p = (const unsigned char*)data;
+		const unsigned char* end = p + size;
+
+		// The header is text, one keyword and its arguments per line
+		std::vector<PlyElement> elements;
+		bool bigEndian = false;
+		bool first = true;
+		for (;;)
+		{
+			const unsigned char* eol = (const unsigned char*)memchr(p, '\n', end - p);
+			if (!eol) return ioError(error, "PLY header is truncated");
+			std::vector<std::string> words;
+			for (const unsigned char* q = p; q < eol;)
+			{
+				while (q < eol && isspace(*q)) q++;
+				const unsigned char* w = q;
+				while (q < eol && !isspace(*q)) q++;
+				if (q > w) words.push_back(std::string((const char*)w, q - w));
+			}
+			p = eol + 1;
+			if (first)
+			{
+				if (words.size() != 1 || words[0] != "ply") return ioError(error, "not a PLY file");
+				first = false;
+				continue;
+			}
+			if (words.empty() || words[0] == "comment" || words[0] == "obj_info") continue;
+			if (words[0] == "end_header") break;
+			if (words[0] == "format" && words.size() >= 2)
+			{
+				if (words[1] == "binary_little_endian") bigEndian = false;
+				else if (words[1] == "binary_big_endian") bigEndian = true;
+				else return ioError(error, "PLY format " + words[1] + " is not supported");
+			}
+			else if (words[0] == "element" && words.size() == 3)
+			{
+				PlyElement e;
+				e.name = words[1];
+				e.count = (size_t)strtoull(words[2].c_str(), nullptr, 10);
+				elements.push_back(e);
+			}
+			else if (words[0] == "property" && !elements.empty())
+			{
+				PlyProperty prop;
+				bool list = words.size() == 5 && words[1] == "list";
+				if (!list && words.size() != 3) return ioError(error, "bad PLY property");
+				prop.name = words.back();
+				prop.countType = list ? PlyProperty::typeOf(words[2]) : PlyProperty::NONE;
+				prop.type = PlyProperty::typeOf(words[list ? 3 : 1]);
+				if (prop.type == PlyProperty::NONE || (list && prop.countType == PlyProperty::NONE))
+				{
+					return ioError(error, "bad PLY property type");
+				}
+				elements.back().properties.push_back(prop);
+			}
+			else
+			{
+				return ioError(error, "bad PLY header line " + words[0]);
+			}
+		}
+		bool swap = bigEndian != FileWriter::hostIsBigEndian();
+
+		const PlyElement* vertexElement = nullptr;
+		for (const PlyElement& e : elements)
+		{
+			if (e.name == "vertex") vertexElement = &e;
+		}
+		if (!vertexElement) return ioError(error, "PLY file has no vertices");
+		if (vertexElement->count >= ~0u) return ioError(error, "too many PLY vertices");
+		unsigned vertexCount = (unsigned)vertexElement->count;
+
+		// Attributes of the pool, from the vertex properties
+		const PlyElement& ve = *vertexElement;
+		const char* names[][3] = {
+			{ "x", "y", "z" },
+			{ "nx", "ny", "nz" },
+			{ "red", "green", "blue" },
+		};
+		long offsets[3][3];
+		PlyProperty::eType types[3][3];
+		bool present[3];
+		for (int a = 0; a < 3; a++)
+		{
+			present[a] = true;
+			for (int k = 0; k < 3; k++)
+			{
+				offsets[a][k] = ve.offsetOf(names[a][k]);
+				const PlyProperty* prop = ve.find(names[a][k]);
+				types[a][k] = prop ? prop->type : PlyProperty::NONE;
+				if (offsets[a][k] < 0) present[a] = false;
+			}
+		}
+		if (!present[0]) return ioError(error, "PLY vertices have no positions");
+		long uvOffsets[2] = { -1, -1 };
+		PlyProperty::eType uvTypes[2] = { PlyProperty::NONE, PlyProperty::NONE };
+		const char* uvNames[][2] = { { "u", "v" }, { "s", "t" }, { "texture_u", "texture_v" }, { "texture_s", "texture_t" } };
+		for (auto& uvName : uvNames)
+		{
+			if (ve.offsetOf(uvName[0]) < 0 || ve.offsetOf(uvName[1]) < 0) continue;
+			for (int k = 0; k < 2; k++)
+			{
+				uvOffsets[k] = ve.offsetOf(uvName[k]);
+				uvTypes[k] = ve.find(uvName[k])->type;
+			}
+			break;
+		}
+		std::vector<long> userOffsets;
+		std::vector<PlyProperty::eType> userTypes;
+		while (ve.offsetOf("user" + std::to_string(userOffsets.size())) >= 0)
+		{
+			const std::string name = "user" + std::to_string(userOffsets.size());
+			userOffsets.push_back(ve.offsetOf(name));
+			userTypes.push_back(ve.find(name)->type);
+		}
+		// Integer colors are scaled to [0, 1]
+		real colorScale = 1.f;
+		if (types[2][0] == PlyProperty::UINT8) colorScale = real(1.0 / 255.0);
+		else if (types[2][0] == PlyProperty::UINT16) colorScale = real(1.0 / 65535.0);
+
+		unsigned attributes = (present[1] ? ATTR_NORMAL : 0) | (present[2] ? ATTR_COLOR : 0) | (uvOffsets[0] >= 0 ? ATTR_UV : 0);
+		csg = CSGT<real>(VertexPoolT<real>(attributes, (unsigned)userOffsets.size()), std::vector< PolygonT<real> >());
+		VertexPoolT<real>& pool = csg.pool;
+
+		for (const PlyElement& e : elements)
+		{
+			if (&e == vertexElement)
+			{
+				size_t stride = e.stride();
+				if (stride == 0) return ioError(error, "PLY vertices with list properties are not supported");
+				if ((size_t)(end - p) / stride < e.count) return ioError(error, "PLY file is truncated");
+				for (unsigned i = 0; i < vertexCount; i++, p += stride)
+				{
+					vec3 values[3];
+					for (int a = 0; a < 3; a++)
+					{
+						if (!present[a]) continue;
+						values[a] = vec3(
+							(real)PlyProperty::load(p + offsets[a][0], types[a][0], swap),
+							(real)PlyProperty::load(p + offsets[a][1], types[a][1], swap),
+							(real)PlyProperty::load(p + offsets[a][2], types[a][2], swap));
+					}
+					VertexT<real> v(values[0], values[1], values[2] * colorScale);
+					if (attributes & ATTR_UV)
+					{
+						v.uv = tvec2<real>(
+							(real)PlyProperty::load(p + uvOffsets[0], uvTypes[0], swap),
+							(real)PlyProperty::load(p + uvOffsets[1], uvTypes[1], swap));
+					}
+					unsigned vi = pool.add(v);
+					for (unsigned k = 0; k < (unsigned)userOffsets.size(); k++)
+					{
+						pool.userAttribute(vi, k) = (real)PlyProperty::load(p + userOffsets[k], userTypes[k], swap);
+					}
+				}
+			}
+			else if (e.name == "face")
+			{
+				const PlyProperty* list = e.find("vertex_indices");
+				if (!list) list = e.find("vertex_index");
+				if (!list || list->countType == PlyProperty::NONE) return ioError(error, "PLY faces have no vertex index list");
+				// Faces refer to the vertices read so far
+				if (pool.size() < vertexCount) return ioError(error, "PLY faces before vertices are not supported");
+				csg.polygons.reserve(csg.polygons.size() + e.count);
+				IndexList indices;
+				for (size_t f = 0; f < e.count; f++)
+				{
+					for (const PlyProperty& prop : e.properties)
+					{
+						if (&prop != list)
+						{
+							PlyElement one;
+							one.properties.push_back(prop);
+							if (!one.skip(p, end, swap)) return ioError(error, "PLY file is truncated");
+							continue;
+						}
+						size_t countBytes = PlyProperty::sizeOf(prop.countType);
+						size_t indexBytes = PlyProperty::sizeOf(prop.type);
+						if ((size_t)(end - p) < countBytes) return ioError(error, "PLY file is truncated");
+						size_t n = (size_t)PlyProperty::load(p, prop.countType, swap);
+						p += countBytes;
+						if ((size_t)(end - p) / indexBytes < n) return ioError(error, "PLY file is truncated");
+						indices.clear();
+						for (size_t k = 0; k < n; k++, p += indexBytes)
+						{
+							double index = PlyProperty::load(p, prop.type, swap);
+							if (index < 0 || index >= pool.size()) return ioError(error, "PLY vertex index out of range");
+							indices.push_back((unsigned)index);
+						}
+					}
+					addMeshFace(csg, indices);
+				}
+			}
+			else
+			{
+				for (size_t i = 0; i < e.count; i++)
+				{
+					if (!e.skip(p, end, swap)) return ioError(error, "PLY file is truncated");
+				}
+			}
+		}
+		csg.invalidate();
+		return true;
+	}
+
+	template<typename real>
+	bool readPLY(const char* path, CSGT<real>& csg, std::string* error = nullptr)
+	{
+		MappedFile file;
+		if (!file.open(path)) return ioError(error, std::string("cannot open ") + path);
+		return parsePLY(file.data, file.size, csg, error);
+	}
+
+	template<typename real>
+	void writeSTLTriangle(FileWriter& out, tvec3<real> normal, tvec3<real> a, tvec3<real> b, tvec3<real> c)
+	{
+		for (tvec3<real> v : { normal, a, b, c })
+		{
+			out.put((float)v.x);
+			out.put((float)v.y);
+			out.put((float)v.z);
+		}
+		out.put(uint16_t(0));
+	}
+
+	inline void writeSTLHeader(FileWriter& out, uint32_t triangles)
+	{
+		char header[80] = "binary STL written by csg.hpp";
+		out.write(header, sizeof(header));
+		out.put(triangles);
+	}
+
+	// Write the polygons of 'csg' as binary STL, each as a fan of triangles
+	template<typename real>
+	bool writeSTL(const char* path, const CSGT<real>& csg, std::string* error = nullptr)
+	{
+		uint32_t triangles = 0;
+		for (const PolygonT<real>& poly : csg.polygons)
+		{
+			if (poly.vertices.size() >= 3) triangles += poly.vertices.size() - 2;
+		}
+		FileWriter out;
+		if (!out.open(path)) return ioError(error, std::string("cannot create ") + path);
+		writeSTLHeader(out, triangles);
+		for (const PolygonT<real>& poly : csg.polygons)
+		{
+			for (unsigned i = 2; i < poly.vertices.size(); i++)
+			{
+				writeSTLTriangle(out, poly.plane.normal, csg.pool.pos(poly.vertices[0]),
+					csg.pool.pos(poly.vertices[i - 1]), csg.pool.pos(poly.vertices[i]));
+			}
+		}
+		if (!out.close()) return ioError(error, std::string("cannot write ") + path);
+		return true;
+	}
+
+	template<typename real>
+	bool writeSTL(const char* path, const ModelT<real>& model, std::string* error = nullptr)
+	{
+		typedef tvec3<real> vec3;
+		FileWriter out;
+		if (!out.open(path)) return ioError(error, std::string("cannot create ") + path);
+		writeSTLHeader(out, (uint32_t)(model.index.size() / 3));
+		for (size_t i = 0; i + 2 < model.index.size(); i += 3)
+		{
+			vec3 a = model.vertices[model.index[i]].pos;
+			vec3 b = model.vertices[model.index[i + 1]].pos;
+			vec3 c = model.vertices[model.index[i + 2]].pos;
+			vec3 n = cross(b - a, c - a);
+			writeSTLTriangle(out, n.length() > 0.f ? n.unit() : vec3(0.f), a, b, c);
+		}
+		if (!out.close()) return ioError(error, std::string("cannot write ") + path);
+		return true;
+	}
+
+	// Header of the PLY files written by writePLY, positions and other reals
+	// are stored as 'real'
+	template<typename real>
+	void writePLYHeader(FileWriter& out, size_t vertices, unsigned attributes, unsigned userAttributes,
+		size_t faces, bool largeFaces)
+	{
+		const char* type = sizeof(real) == 8 ? "double" : "float";
+		std::string header = "ply\nformat binary_little_endian 1.0\ncomment written by csg.hpp\n";
+		header += "element vertex " + std::to_string(vertices) + "\n";
+		for (const char* name : { "x", "y", "z" }) header += std::string("property ") + type + " " + name + "\n";
+		if (attributes & ATTR_NORMAL)
+		{
+			for (const char* name : { "nx", "ny", "nz" }) header += std::string("property ") + type + " " + name + "\n";
+		}
+		if (attributes & ATTR_COLOR)
+		{
+			for (const char* name : { "red", "green", "blue" }) header += std::string("property uchar ") + name + "\n";
+		}
+		if (attributes & ATTR_UV)
+		{
+			for (const char* name : { "u", "v" }) header += std::string("property ") + type + " " + name + "\n";
+		}
+		for (unsigned k = 0; k < userAttributes; k++)
+		{
+			header += std::string("property ") + type + " user" + std::to_string(k) + "\n";
+		}
+		header += "element face " + std::to_string(faces) + "\n";
+		header += largeFaces ? "property list uint uint vertex_indices\n" : "property list uchar uint vertex_indices\n";
+		header += "end_header\n";
+		out.write(header);
+	}
+
+	template<typename real>
+	void writePLYVertex(FileWriter& out, const VertexT<real>& v, unsigned attributes)
+	{
+		out.put(v.pos.x);
+		out.put(v.pos.y);
+		out.put(v.pos.z);
+		if (attributes & ATTR_NORMAL)
+		{
+			out.put(v.normal.x);
+			out.put(v.normal.y);
+			out.put(v.normal.z);
+		}
+		if (attributes & ATTR_COLOR)
+		{
+			for (real c : { v.color.x, v.color.y, v.color.z })
+			{
+				out.put((uint8_t)(std::min(std::max(c, real(0)), real(1)) * 255.f + 0.5f));
+			}
+		}
+		if (attributes & ATTR_UV)
+		{
+			out.put(v.uv.x);
+			out.put(v.uv.y);
+		}
+	}
+
+	// Write the vertex pool and polygons of 'csg' as binary PLY, with the
+	// attributes the pool has. Normals of vertices used by flipped polygons
+	// are written flipped, as Polygon::vertex returns them; vertices used by
+	// both flipped and unflipped polygons get a flipped copy after the pool.
+	template<typename real>
+	bool writePLY(const char* path, const CSGT<real>& csg, std::string* error = nullptr)
+	{
+		const VertexPoolT<real>& pool = csg.pool;
+		size_t faces = 0;
+		bool largeFaces = false;
+		// Per vertex, 1 if used by an unflipped polygon, 2 by a flipped one
+		std::vector<unsigned char> uses(pool.has(ATTR_NORMAL) ? pool.size() : 0, 0);
+		for (const PolygonT<real>& poly : csg.polygons)
+		{
+			if (poly.vertices.size() < 3) continue;
+			faces++;
+			largeFaces |= poly.vertices.size() > 255;
+			if (!uses.empty())
+			{
+				for (unsigned vi : poly.vertices) uses[vi] |= poly.flipped ? 2 : 1;
+			}
+		}
+		const unsigned NONE = ~0u;
+		std::vector<unsigned> flippedCopy(uses.size(), NONE);
+		std::vector<unsigned> copied;
+		for (unsigned i = 0; i < uses.size(); i++)
+		{
+			if (uses[i] != 3) continue;
+			flippedCopy[i] = pool.size() + (unsigned)copied.size();
+			copied.push_back(i);
+		}
+
+		FileWriter out;
+		if (!out.open(path)) return ioError(error, std::string("cannot create ") + path);
+		writePLYHeader<real>(out, pool.size() + copied.size(), pool.attributes, pool.userAttributes(), faces, largeFaces);
+		auto writeVertex = [&](unsigned i, bool flip)
+		{
+			VertexT<real> v = pool.vertex(i);
+			if (flip) v.flip();
+			writePLYVertex(out, v, pool.attributes);
+			for (unsigned k = 0; k < pool.userAttributes(); k++)
+			{
+				out.put(pool.userAttribute(i, k));
+			}
+		};
+		for (unsigned i = 0; i < pool.size(); i++) writeVertex(i, !uses.empty() && uses[i] == 2);
+		for (unsigned i : copied) writeVertex(i, true);
+		for (const PolygonT<real>& poly : csg.polygons)
+		{
+			if (poly.vertices.size() < 3) continue;
+			if (largeFaces) out.put((uint32_t)poly.vertices.size());
+			else out.put((uint8_t)poly.vertices.size());
+			for (unsigned vi : poly.vertices)
+			{
+				bool copy = poly.flipped && !uses.empty() && flippedCopy[vi] != NONE;
+				out.put((uint32_t)(copy ? flippedCopy[vi] : vi));
+			}
+		}
+		if (!out.close()) return ioError(error, std::string("cannot write ") + path);
+		return true;
+	}
+
+	// Write 'model' as binary PLY with the vertex 'attributes' given
+	template<typename real>
+	bool writePLY(const char* path, const ModelT<real>& model, unsigned attributes = ATTR_NORMAL | ATTR_COLOR,
+		std::string* error = nullptr)
+	{
+		FileWriter out;
+		if (!out.open(path)) return ioError(error, std::string("cannot create ") + path);
+		writePLYHeader<real>(out, model.vertices.size(), attributes, 0, model.index.size() / 3, false);
+		for (const VertexT<real>& v : model.vertices) writePLYVertex(out, v, attributes);
+		for (size_t i = 0; i + 2 < model.index.size(); i += 3)
+		{
+			out.put(uint8_t(3));
+			out.put((uint32_t)model.index[i]);
+			out.put((uint32_t)model.index[i + 1]);
+			out.put((uint32_t)model.index[i + 2]);
+		}
+		if (!out.close()) return ioError(error, std::string("cannot write ") + path);
+		return true;
+	}
+
+	// Real stored as a float or double of 'scalarSize' bytes at 'p'
+	template<typename real>
+	real loadReal(const unsigned char* p, unsigned scalarSize, bool swap)
+	{
+		return scalarSize == 8 ? (real)loadBytes<double>(p, swap) : (real)loadBytes<float>(p, swap);
+	}
+
+	struct SnapshotHeader
+	{
+		// Start of a snapshot file, see writeSnapshot. The sections follow,
+		// each at a multiple of 8 bytes from the start of the file, so that
+		// the values of a mapped file are aligned. The reader copies them
+		// into a VertexPool and a NodeArena: what a snapshot saves is
+		// building the tree, not reading it. All values are little endian;
+		// reals are floats or doubles as given by 'scalarSize'.
+		enum { VERSION = 1, SIZE = 192 };
+		enum eSection {
+			POSITIONS,     // 3 reals per vertex
+			NORMALS,       // 3 reals per vertex, if 'attributes' has ATTR_NORMAL
+			COLORS,        // 3 reals per vertex, if ATTR_COLOR
+			UVS,           // 2 reals per vertex, if ATTR_UV
+			USER,          // 'userAttributes' streams of one real per vertex
+			POLYGONS,      // a polygon record per polygon
+			INDICES,       // uint32 vertex indices of the polygons
+			NODES,         // a node record per BSP node, parents before children
+			TREE_POLYGONS, // a polygon record per polygon kept in a BSP node
+			TREE_INDICES,  // uint32 vertex indices of those polygons
+			SECTIONS
+		};
+
+		// Polygon record: uint32 first index, index count, shared, flipped,
+		// lineage and a zero, then the plane's normal and w as 4 reals.
+		// Node record: the plane as 4 reals, then uint32 front and back node
+		// (~0 for none), first polygon and polygon count. The polygons of the
+		// nodes follow each other in node order.
+		uint64_t polygonRecordSize() const
+		{
+			return 24 + 4 * scalarSize;
+		}
+
+		uint64_t nodeRecordSize() const
+		{
+			return 16 + 4 * scalarSize;
+		}
+
+		uint64_t sectionSize(int k) const
+		{
+			uint64_t n = vertices;
+			switch (k)
+			{
+			case POSITIONS: return 3 * n * scalarSize;
+			case NORMALS: return (attributes & ATTR_NORMAL) ? 3 * n * scalarSize : 0;
+			case COLORS: return (attributes & ATTR_COLOR) ? 3 * n * scalarSize : 0;
+			case UVS: return (attributes & ATTR_UV) ? 2 * n * scalarSize : 0;
+			case USER: return (uint64_t)userAttributes * n * scalarSize;
+			case POLYGONS: return polygons * polygonRecordSize();
+			case INDICES: return 4 * (uint64_t)indices;
+			case NODES: return nodes * nodeRecordSize();
+			case TREE_POLYGONS: return treePolygons * polygonRecordSize();
+			case TREE_INDICES: return 4 * (uint64_t)treeIndices;
+			default: return 0;
+			}
+		}
+
+		// Lay the sections out after the header
+		void place()
+		{
+			uint64_t offset = SIZE;
+			for (int k = 0; k < SECTIONS; k++)
+			{
+				offsets[k] = offset;
+				offset = (offset + sectionSize(k) + 7) & ~uint64_t(7);
+			}
+		}
+
+		void write(FileWriter& out) const
+		{
+			out.write("CSGSNAP", 8);
+			for (uint32_t v : { version, scalarSize, attributes, userAttributes, vertices, polygons, indices,
+				nodes, treePolygons, treeIndices, treeInverted, treeSplits })
+			{
+				out.put(v);
+			}
+			for (double b : treeBounds) out.put(b);
+			for (uint64_t offset : offsets) out.put(offset);
+			out.align(8);
+			while (out.offset < SIZE) out.put(uint64_t(0));
+		}
+
+		bool read(const unsigned char* p, size_t size, bool swap, std::string* error)
+		{
+			if (size < SIZE || memcmp(p, "CSGSNAP", 8) != 0) return ioError(error, "not a snapshot");
+			p += 8;
+			for (uint32_t* v : { &version, &scalarSize, &attributes, &userAttributes, &vertices, &polygons, &indices,
+				&nodes, &treePolygons, &treeIndices, &treeInverted, &treeSplits })
+			{
+				*v = loadBytes<uint32_t>(p, swap);
+				p += 4;
+			}
+			for (double& b : treeBounds) { b = loadBytes<double>(p, swap); p += 8; }
+			for (uint64_t& offset : offsets) { offset = loadBytes<uint64_t>(p, swap); p += 8; }
+			if (version != VERSION) return ioError(error, "snapshot version " + std::to_string(version) + " is not supported");
+			if (scalarSize != 4 && scalarSize != 8) return ioError(error, "bad snapshot scalar size");
+			if (userAttributes > 256) return ioError(error, "bad snapshot attributes");
+			for (int k = 0; k < SECTIONS; k++)
+			{
+				if (offsets[k] > size || sectionSize(k) > size - offsets[k]) return ioError(error, "snapshot is truncated");
+			}
+			return true;
+		}
+
+		uint32_t version;
+		uint32_t scalarSize;
+		uint32_t attributes;     // of the vertex pool, see eAttribute
+		uint32_t userAttributes;
+		uint32_t vertices;
+		uint32_t polygons;
+		uint32_t indices;
+		uint32_t nodes;          // 0 if the snapshot has no BSP tree
+		uint32_t treePolygons;
+		uint32_t treeIndices;
+		uint32_t treeInverted;
+		uint32_t treeSplits;
+		double treeBounds[6];    // min and max
+		uint64_t offsets[SECTIONS];
+	};
+
+	template<typename real>
+	void writePolygonRecord(FileWriter& out, const PolygonT<real>& poly, uint32_t first)
+	{
+		out.put(first);
+		out.put((uint32_t)poly.vertices.size());
+		out.put((uint32_t)poly.shared);
+		out.put((uint32_t)poly.flipped);
+		out.put((uint32_t)poly.lineage);
+		out.put(uint32_t(0));
+		out.put(poly.plane.normal.x);
+		out.put(poly.plane.normal.y);
+		out.put(poly.plane.normal.z);
+		out.put(poly.plane.w);
+	}
+
+	// Polygons of the records at 'records', with indices into 'indices'
+	template<typename real>
+	bool readPolygonRecords(const unsigned char* records, uint32_t count, const unsigned char* indices, uint32_t indexCount,
+		const SnapshotHeader& h, bool swap, std::vector< PolygonT<real> >& polygons, std::string* error)
+	{
+		typedef tvec3<real> vec3;
+		unsigned S = h.scalarSize;
+		polygons.reserve(polygons.size() + count);
+		for (uint32_t i = 0; i < count; i++, records += h.polygonRecordSize())
+		{
+			uint32_t first = loadBytes<uint32_t>(records, swap);
+			uint32_t n = loadBytes<uint32_t>(records + 4, swap);
+			if (first > indexCount || n > indexCount - first) return ioError(error, "bad snapshot polygon");
+			const unsigned char* r = records + 24;
+			PlaneT<real> plane(vec3(loadReal<real>(r, S, swap), loadReal<real>(r + S, S, swap), loadReal<real>(r + 2 * S, S, swap)),
+				loadReal<real>(r + 3 * S, S, swap));
+			IndexList list;
+			list.reserve(n);
+			for (uint32_t k = 0; k < n; k++)
+			{
+				uint32_t vi = loadBytes<uint32_t>(indices + 4 * (first + k), swap);
+				if (vi >= h.vertices) return ioError(error, "bad snapshot vertex index");
+				list.push_back(vi);
+			}
+			polygons.push_back(PolygonT<real>(std::move(list), plane, loadBytes<uint32_t>(records + 8, swap)));
+			polygons.back().flipped = loadBytes<uint32_t>(records + 12, swap) != 0;
+			polygons.back().lineage = loadBytes<uint32_t>(records + 16, swap);
+		}
+		return true;
+	}
+
+	// Write 'csg' as a snapshot: its vertex pool and polygons and, with
+	// 'withTree', its BSP tree (built on a copy if 'csg' has none cached,
+	// see CSG::tree()). Reading the snapshot back restores the tree without
+	// building it.
+	template<typename real>
+	bool writeSnapshot(const char* path, const CSGT<real>& csg, bool withTree = true, std::string* error = nullptr)
+	{
+		// Building the tree adds the vertices of split polygons to the pool
+		if (withTree && !csg.cachedTree())
+		{
+			CSGT<real> built(csg);
+			built.tree();
+			return writeSnapshot(path, built, true, error);
+		}
+		const NodeT<real>* tree = withTree ? csg.cachedTree() : nullptr;
+		const VertexPoolT<real>& pool = csg.pool;
+
+		SnapshotHeader h;
+		memset(&h, 0, sizeof(h));
+		h.version = SnapshotHeader::VERSION;
+		h.scalarSize = sizeof(real);
+		h.attributes = pool.attributes;
+		h.userAttributes = pool.userAttributes();
+		h.vertices = pool.size();
+		h.polygons = (uint32_t)csg.polygons.size();
+		for (const PolygonT<real>& poly : csg.polygons) h.indices += poly.vertices.size();
+
+		// Number the nodes breadth first, so children come after their parent
+		std::vector<unsigned> order;
+		std::vector<unsigned> number;
+		if (tree)
+		{
+			const NodeArenaT<real>& arena = *tree->arena;
+			number.assign(arena.size(), NO_NODE);
+			order.push_back(tree->root);
+			number[tree->root] = 0;
+			for (size_t head = 0; head < order.size(); head++)
+			{
+				const BSPNodeT<real>& n = arena[order[head]];
+				for (unsigned child : { n.front, n.back })
+				{
+					if (child == NO_NODE) continue;
+					number[child] = (unsigned)order.size();
+					order.push_back(child);
+				}
+				h.treePolygons += (uint32_t)n.polygons.size();
+				for (const PolygonT<real>& poly : n.polygons) h.treeIndices += poly.vertices.size();
+			}
+			h.nodes = (uint32_t)order.size();
+			h.treeInverted = tree->inverted;
+			h.treeSplits = tree->splits.load();
+			const real* bounds[] = { &tree->bounds.min.x, &tree->bounds.min.y, &tree->bounds.min.z,
+				&tree->bounds.max.x, &tree->bounds.max.y, &tree->bounds.max.z };
+			for (int k = 0; k < 6; k++) h.treeBounds[k] = *bounds[k];
+		}
+		h.place();
+
+		FileWriter out;
+		if (!out.open(path)) return ioError(error, std::string("cannot create ") + path);
+		h.write(out);
+		auto section = [&](int k)
+		{
+			out.align(8);
+			assert(out.offset == h.offsets[k]);
+			(void)k;
+		};
+		section(SnapshotHeader::POSITIONS);
+		for (unsigned i = 0; i < pool.size(); i++)
+		{
+			const tvec3<real>& p = pool.pos(i);
+			out.put(p.x); out.put(p.y); out.put(p.z);
+		}
+		section(SnapshotHeader::NORMALS);
+		if (pool.has(ATTR_NORMAL)) for (unsigned i = 0; i < pool.size(); i++)
+		{
+			const tvec3<real>& n = pool.normals[i];
+			out.put(n.x); out.put(n.y); out.put(n.z);
+		}
+		section(SnapshotHeader::COLORS);
+		if (pool.has(ATTR_COLOR)) for (unsigned i = 0; i < pool.size(); i++)
+		{
+			const tvec3<real>& c = pool.colors[i];
+			out.put(c.x); out.put(c.y); out.put(c.z);
+		}
+		section(SnapshotHeader::UVS);
+		if (pool.has(ATTR_UV)) for (unsigned i = 0; i < pool.size(); i++)
+		{
+			out.put(pool.uvs[i].x); out.put(pool.uvs[i].y);
+		}
+		section(SnapshotHeader::USER);
+		for (unsigned k = 0; k < pool.userAttributes(); k++)
+		{
+			for (unsigned i = 0; i < pool.size(); i++) out.put(pool.userAttribute(i, k));
+		}
+		section(SnapshotHeader::POLYGONS);
+		uint32_t first = 0;
+		for (const PolygonT<real>& poly : csg.polygons)
+		{
+			writePolygonRecord(out, poly, first);
+			first += poly.vertices.size();
+		}
+		section(SnapshotHeader::INDICES);
+		for (const PolygonT<real>& poly : csg.polygons)
+		{
+			for (unsigned vi : poly.vertices) out.put((uint32_t)vi);
+		}
+		if (tree)
+		{
+			const NodeArenaT<real>& arena = *tree->arena;
+			section(SnapshotHeader::NODES);
+			uint32_t firstPolygon = 0;
+			for (unsigned ni : order)
+			{
+				const BSPNodeT<real>& n = arena[ni];
+				out.put(n.plane.normal.x); out.put(n.plane.normal.y); out.put(n.plane.normal.z); out.put(n.plane.w);
+				out.put((uint32_t)(n.front == NO_NODE ? NO_NODE : number[n.front]));
+				out.put((uint32_t)(n.back == NO_NODE ? NO_NODE : number[n.back]));
+				out.put(firstPolygon);
+				out.put((uint32_t)n.polygons.size());
+				firstPolygon += (uint32_t)n.polygons.size();
+			}
+			section(SnapshotHeader::TREE_POLYGONS);
+			first = 0;
+			for (unsigned ni : order)
+			{
+				for (const PolygonT<real>& poly : arena[ni].polygons)
+				{
+					writePolygonRecord(out, poly, first);
+					first += poly.vertices.size();
+				}
+			}
+			section(SnapshotHeader::TREE_INDICES);
+			for (unsigned ni : order)
+			{
+				for (const PolygonT<real>& poly : arena[ni].polygons)
+				{
+					for (unsigned vi : poly.vertices) out.put((uint32_t)vi);
+				}
+			}
+		}
+		out.align(8); // empty sections at the end start at the end of the file
+		if (!out.close()) return ioError(error, std::string("cannot write ") + path);
+		return true;
+	}
+
+	// Read a snapshot written by writeSnapshot from memory. Its BSP tree, if
+	// it has one, becomes the cached tree of 'csg', so the next boolean
+	// operation uses it as it is. Snapshots of floats can be read into CSGd
+	// and the other way round.
+	template<typename real>
+	bool parseSnapshot(const void* data, size_t size, CSGT<real>& csg, std::string* error = nullptr)
+	{
+		typedef tvec3<real> vec3;
+		const unsigned char* bytes = (const unsigned char*)data;
+		bool swap = FileWriter::hostIsBigEndian();
+		SnapshotHeader h;
+		if (!h.read(bytes, size, swap, error)) return false;
+		unsigned S = h.scalarSize;
+		auto vec3At = [&](int section, uint32_t i)
+		{
+			const unsigned char* p = bytes + h.offsets[section] + 3 * S * (uint64_t)i;
+			return vec3(loadReal<real>(p, S, swap), loadReal<real>(p + S, S, swap), loadReal<real>(p + 2 * S, S, swap));
+		};
+
+		csg = CSGT<real>(VertexPoolT<real>(h.attributes, h.userAttributes), std::vector< PolygonT<real> >());
+		VertexPoolT<real>& pool = csg.pool;
+		for (uint32_t i = 0; i < h.vertices; i++)
+		{
+			VertexT<real> v;
+			v.pos = vec3At(SnapshotHeader::POSITIONS, i);
+			if (h.attributes & ATTR_NORMAL) v.normal = vec3At(SnapshotHeader::NORMALS, i);
+			if (h.attributes & ATTR_COLOR) v.color = vec3At(SnapshotHeader::COLORS, i);
+			if (h.attributes & ATTR_UV)
+			{
+				const unsigned char* p = bytes + h.offsets[SnapshotHeader::UVS] + 2 * S * (uint64_t)i;
+				v.uv = tvec2<real>(loadReal<real>(p, S, swap), loadReal<real>(p + S, S, swap));
+			}
+			unsigned vi = pool.add(v);
+			for (unsigned k = 0; k < h.userAttributes; k++)
+			{
+				const unsigned char* p = bytes + h.offsets[SnapshotHeader::USER] + ((uint64_t)k * h.vertices + i) * S;
+				pool.userAttribute(vi, k) = loadReal<real>(p, S, swap);
+			}
+		}
+		if (!readPolygonRecords(bytes + h.offsets[SnapshotHeader::POLYGONS], h.polygons,
+			bytes + h.offsets[SnapshotHeader::INDICES], h.indices, h, swap, csg.polygons, error))
+		{
+			return false;
+		}
+
+		if (h.nodes > 0)
+		{
+			std::vector< PolygonT<real> > treePolygons;
+			if (!readPolygonRecords(bytes + h.offsets[SnapshotHeader::TREE_POLYGONS], h.treePolygons,
+				bytes + h.offsets[SnapshotHeader::TREE_INDICES], h.treeIndices, h, swap, treePolygons, error))
+			{
+				return false;
+			}
+			std::unique_ptr< NodeT<real> > tree(new NodeT<real>(pool));
+			std::vector<unsigned> ids(h.nodes);
+			ids[0] = tree->root;
+			for (uint32_t i = 1; i < h.nodes; i++) ids[i] = tree->arena->alloc();
+			const unsigned char* r = bytes + h.offsets[SnapshotHeader::NODES];
+			uint32_t nextPolygon = 0;
+			std::vector<bool> referenced(h.nodes, false);
+			for (uint32_t i = 0; i < h.nodes; i++, r += h.nodeRecordSize())
+			{
+				BSPNodeT<real>& n = (*tree->arena)[ids[i]];
+				n.plane = PlaneT<real>(vec3(loadReal<real>(r, S, swap), loadReal<real>(r + S, S, swap), loadReal<real>(r + 2 * S, S, swap)),
+					loadReal<real>(r + 3 * S, S, swap));
+				const unsigned char* q = r + 4 * S;
+				uint32_t front = loadBytes<uint32_t>(q, swap);
+				uint32_t back = loadBytes<uint32_t>(q + 4, swap);
+				uint32_t firstPolygon = loadBytes<uint32_t>(q + 8, swap);
+				uint32_t count = loadBytes<uint32_t>(q + 12, swap);
+				// Children after their parent rule out cycles, and a single
+				// parent per node rules out shared subtrees
+				for (uint32_t child : { front, back })
+				{
+					if (child == NO_NODE) continue;
+					if (child <= i || child >= h.nodes || referenced[child]) return ioError(error, "bad snapshot node");
+					referenced[child] = true;
+				}
+				if (firstPolygon != nextPolygon || count > h.treePolygons - nextPolygon) return ioError(error, "bad snapshot node");
+				n.front = front == NO_NODE ? NO_NODE : ids[front];
+				n.back = back == NO_NODE ? NO_NODE : ids[back];
+				n.polygons.assign(std::make_move_iterator(treePolygons.begin() + firstPolygon),
+					std::make_move_iterator(treePolygons.begin() + firstPolygon + count));
+				nextPolygon += count;
+			}
+			tree->inverted = h.treeInverted != 0;
+			tree->splits = h.treeSplits;
+			tree->bounds.min = vec3((real)h.treeBounds[0], (real)h.treeBounds[1], (real)h.treeBounds[2]);
+			tree->bounds.max = vec3((real)h.treeBounds[3], (real)h.treeBounds[4], (real)h.treeBounds[5]);
+			csg.cacheTree(std::move(tree));
+		}
+		return true;
+	}
+
+	template<typename real>
+	bool readSnapshot(const char* path, CSGT<real>& csg, std::string* error = nullptr)
+	{
+		MappedFile file;
+		if (!file.open(path)) return ioError(error, std::string("cannot open ") + path);
+		return parseSnapshot(file.data, file.size, csg, error);
+	}
+
+} // namespace csghpp
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work stealing thread pool used by csg.hpp for the parallel BSP passes.
+
+namespace csghpp
+{
+	struct ThreadPool;
+
+	struct TaskGroup
+	{
+		// A set of tasks that can be waited for together.
+		// Tasks may add more tasks to the group they run in.
+		TaskGroup(ThreadPool& _pool)
+			: pool(_pool)
+			, pending(0)
+		{
+		}
+
+		~TaskGroup()
+		{
+			waitNoThrow();
+		}
+
+		template<typename F>
+		void run(F&& f);
+
+		// Wait until all tasks of the group have finished, running pending tasks
+		// on this thread meanwhile. Rethrows the first exception thrown by a task.
+		void wait()
+		{
+			waitNoThrow();
+			std::exception_ptr e;
+			{
+				std::lock_guard<std::mutex> lock(errorMutex);
+				std::swap(e, error);
+			}
+			if (e) std::rethrow_exception(e);
+		}
+
+		void waitNoThrow();
+
+		ThreadPool& pool;
+		std::atomic<unsigned> pending;
+		std::mutex errorMutex;
+		std::exception_ptr error;
+	};
+
+	struct ThreadPool
+	{
+		// Every worker has its own task deque. A worker pushes and pops its own
+		// tasks at the back, so it keeps working on the most recently split (and
+		// cache hot) data, while idle workers steal from the front of the other
+		// deques, where the oldest and largest pieces of work are.
+		// Threads that are not workers of the pool submit to one shared deque.
+		struct Task
+		{
+			std::function<void()> fn;
+			TaskGroup* group;
+		};
+
+		struct Queue
+		{
+			std::mutex mutex;
+			std::deque<Task> tasks;
+		};
+
+		ThreadPool(unsigned threads = std::thread::hardware_concurrency())
+			: queued(0)
+			, stop(false)
+		{
+			if (threads == 0) threads = 1;
+			for (unsigned i = 0; i <= threads; i++)
+			{
+				queues.emplace_back(new Queue);
+			}
+			for (unsigned i = 0; i < threads; i++)
+			{
+				workers.emplace_back([this, i]() { workerLoop(i); });
+			}
+		}
+
+		~ThreadPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(sleepMutex);
+				stop = true;
+			}
+			wake.notify_all();
+			for (std::thread& t : workers) t.join();
+		}
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		// Pool with one worker per hardware thread, created on first use
+		static ThreadPool& shared()
+		{
+			static ThreadPool pool;
+			return pool;
+		}
+
+		unsigned size() const { return (unsigned)workers.size(); }
+
+		// Index of the calling thread's queue: its own one for workers of this
+		// pool, the shared one for any other thread.
+		unsigned queueIndex() const
+		{
+			return current() == this ? workerIndex() : (unsigned)workers.size();
+		}
+
+		void submit(TaskGroup& group, std::function<void()>&& fn)
+		{
+			group.pending.fetch_add(1);
+			Queue& q = *queues[queueIndex()];
+			{
+				std::lock_guard<std::mutex> lock(q.mutex);
+				q.tasks.push_back(Task{ std::move(fn), &group });
+			}
+			queued.fetch_add(1);
+			{
+				// Taking the lock orders this with a worker checking 'queued' before sleeping
+				std::lock_guard<std::mutex> lock(sleepMutex);
+			}
+			wake.notify_one();
+		}
+
+		// Run one pending task if there is any. Returns false if all queues were empty.
+		bool runOne(unsigned self)
+		{
+			Task task;
+			if (!pop(self, task)) return false;
+			try
+			{
+				task.fn();
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(task.group->errorMutex);
+				if (!task.group->error) task.group->error = std::current_exception();
+			}
+			task.group->pending.fetch_sub(1);
+			return true;
+		}
+
+		bool pop(unsigned self, Task& task)
+		{
+			{
+				Queue& q = *queues[self];
+				std::lock_guard<std::mutex> lock(q.mutex);
+				if (!q.tasks.empty())
+				{
+					task = std::move(q.tasks.back());
+					q.tasks.pop_back();
+					queued.fetch_sub(1);
+					return true;
+				}
+			}
+			unsigned n = (unsigned)queues.size();
+			for (unsigned k = 1; k < n; k++)
+			{
+				Queue& q = *queues[(self + k) % n];
+				std::lock_guard<std::mutex> lock(q.mutex);
+				if (!q.tasks.empty())
+				{
+					task = std::move(q.tasks.front());
+					q.tasks.pop_front();
+					queued.fetch_sub(1);
+					return true;
+				}
+			}
+			return false;
+		}
+
+		void workerLoop(unsigned index)
+		{
+			current() = this;
+			workerIndex() = index;
+			for (;;)
+			{
+				if (runOne(index)) continue;
+				std::unique_lock<std::mutex> lock(sleepMutex);
+				wake.wait(lock, [this]() { return stop || queued.load() > 0; });
+				if (stop) return;
+			}
+		}
+
+		static ThreadPool*& current()
+		{
+			static thread_local ThreadPool* pool = nullptr;
+			return pool;
+		}
+
+		static unsigned& workerIndex()
+		{
+			static thread_local unsigned index = 0;
+			return index;
+		}
+
+		std::vector< std::unique_ptr<Queue> > queues;
+		std::vector<std::thread> workers;
+		std::atomic<unsigned> queued;
+		std::mutex sleepMutex;
+		std::condition_variable wake;
+		bool stop;
+	};
+
+	template<typename F>
+	void TaskGroup::run(F&& f)
+	{
+		pool.submit(*this, std::function<void()>(std::forward<F>(f)));
+	}
+
+	inline void TaskGroup::waitNoThrow()
+	{
+		unsigned self = pool.queueIndex();
+		while (pending.load() > 0)
+		{
+			if (!pool.runOne(self)) std::this_thread::yield();
+		}
+	}
+
+} // namespace csghpp
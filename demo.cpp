@@ -3,6 +3,7 @@
 #include <chrono>
 
 #include "csg.hpp"
+#include "demo_scenes.h"
 
 #define ARCBALL_CAMERA_IMPLEMENTATION
 #include "arcball_camera.h"
@@ -17,86 +18,6 @@
 #endif
 
 using namespace csghpp;
-CSG makeThing(float x, float y, int csg_op)
-{
-    printf("Creating shapes...");
-
-    //auto a = CSG::cube(vec3(x, y, .5));
-    //auto b = CSG::sphere(vec3(0,0, .0f), 1.0, 8, 6);
-    //auto b = CSG::cube(vec3(-.25 , -.25 , -.25));
-    //auto b = CSG::cylinder(0.3f, vec3(-2.f, 0, 0), vec3(2.f, 0, 0));
-    //auto b = CSG::sphere(vec3(.25, .25, .25), 1.0, 8, 6);
-    auto a = CSG::cylinder(0.3f, vec3(x, -1.f, y), vec3(0.f, 1.f, 0));
-    auto b = CSG::cylinder(0.3f, vec3(-1.f, 0, 0), vec3(1.f, 0, 0));
-    // 
-    a.setColor(1, 1, 0);
-    b.setColor(0, 0.5, 1);
-    printf("Working on CSG...op%d ", csg_op);
-    CSG c;
-    if (csg_op == 0)
-        c = a.unionOp(b);
-    else if (csg_op == 1)
-        c = a.subOp(b);
-    else
-        c = a.intersectOp(b);
-    printf("completed CSG.\n");
-    return c;
-}
-
-CSG makeThing2()
-{
-    auto a = CSG::cube(vec3(-.25, -.25, -.25));
-    auto b = CSG::sphere(vec3(.25, .25, .25), 1.3);
-
-    a.setColor(1, 1, 0);
-    b.setColor(0, 0.5, 1);
-    return a.subOp(b);
-}
-
-CSG makeThing3()
-{
-    auto a = CSG::cube(vec3(-.25, -.25, -.25));
-    auto b = CSG::sphere(vec3(.25, .25, .25), 1.3);
-    a.setColor(1, 1, 0);
-    b.setColor(0, 0.5, 1);
-    return a.intersectOp(b);
-}
-
-CSG makeThing4()
-{
-    // Generate example from wikipedia
-    auto a = CSG::cube();
-    auto b = CSG::sphere(vec3(0.f), 1.35, 12);
-    auto c = CSG::cylinder(0.7f, vec3(-1.f, 0, 0), vec3(1.f, 0, 0));
-    auto d = CSG::cylinder(0.7f, vec3(0, -1, 0), vec3(0, 1, 0));
-    auto e = CSG::cylinder(0.7f, vec3(0, 0, -1), vec3(0, 0, 1));
-
-    a.setColor(1, 0, 0);
-    b.setColor(0, 0, 1);
-    c.setColor(0, 1, 0);
-    d.setColor(0, 1, 0);
-    e.setColor(0, 1, 0);
-
-    return a.intersectOp(b).subOp((c.unionOp(d).unionOp(e)));
-}
-
-CSG makeThing5()
-{
-    // Generate example from wikipedia
-    auto a = CSG::cube(vec3(0.f), 20.f);
-    auto b = CSG::cube(vec3(0.f), 19.f);
-    auto c = CSG::cube(vec3(0.5f), 0.5f);
-    auto d = CSG::cube(vec3(-0.5f), .5f);
-    auto e = CSG::cube(vec3(-0.5f, -.5, -10.5), vec3(1.f, 10.f, 1.f));
-
-    a.setColor(1, 0, 0);
-    b.setColor(0, 0, 1);
-    c.setColor(0, 1, 0);
-    d.setColor(0, 1, 0);
-    e.setColor(0, 1, 0);
-
-    return a.subOp(b).unionOp(c).unionOp(d).unionOp(e);
-}
 
 /* report GL errors, if any, to stderr */
 void checkError(const char* functionName)
@@ -135,9 +56,16 @@ static float g_old_mouse_wheel = 0.f;
 static float g_mouse_wheel = 0.f;
 static bool need_recalc = false;
 static int csg_op = 0;
+// Shape 3 is evaluated as an expression, so changing the radius of its
+// sphere only redoes the operations that depend on the sphere
+static CSGExpr thing4Sphere;
+static CSGExpr thing4 = makeThing4Expr(thing4Sphere);
+static float thing4Radius = 1.35f;
 
 static CSG csg;
 static Model model;
+// The model as vertex arrays for glDrawElements
+static PackedMesh packed;
 static void recalc_csg()
 {
     float mouse_centerx = mouse_x - (.5f * screen_width);
@@ -161,7 +89,8 @@ static void recalc_csg()
     }
     else if (function_index == 3)
     {
-        csg = makeThing4();
+        thing4Sphere.set(CSGExpr::sphere(vec3(0.f), thing4Radius, 12).setColor(0, 0, 1));
+        csg = *thing4.evaluate();
     }
     else if (function_index == 4)
     {
@@ -169,7 +98,11 @@ static void recalc_csg()
     }
     auto endCsg = clock_type::now();
     
-    model = fromPolygons(csg.polygons);
+    model = fromPolygons(csg);
+    PackOptions packOptions;
+    packOptions.rgba8Colors = true;
+    packOptions.uvs = false;
+    packed = model.pack(packOptions);
     auto endPoly = clock_type::now();
     auto nsCsg = std::chrono::duration_cast<std::chrono::nanoseconds>(endCsg - start).count();
     auto nsPoly = std::chrono::duration_cast<std::chrono::nanoseconds>(endPoly - endCsg).count();
@@ -192,37 +125,27 @@ static void drawCsg(CSG o, bool wire)
         }
         glEnd();
         */
-        
-        for(int i=0; i < model.index.size(); i+=3)
+
+        // Positions and normals are floats, colors RGBA8
+        const uint8_t* base = packed.vertices.data();
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_COLOR_ARRAY);
+        glVertexPointer(3, GL_FLOAT, packed.stride, base + packed.positionOffset);
+        glColorPointer(4, GL_UNSIGNED_BYTE, packed.stride, base + packed.colorOffset);
+        if (!wire)
         {
-            unsigned i0 = model.index[i+0];
-            unsigned i1 = model.index[i+1];
-            unsigned i2 = model.index[i+2];
-            vec3 n0 = model.vertices[i0].normal;
-            vec3 n1 = model.vertices[i1].normal;
-            vec3 n2 = model.vertices[i2].normal;
-            vec3 v0 = model.vertices[i0].pos;
-            vec3 v1 = model.vertices[i1].pos;
-            vec3 v2 = model.vertices[i2].pos;
-            vec3 c0 = model.vertices[i0].color;
-            vec3 c1 = model.vertices[i1].color;
-            vec3 c2 = model.vertices[i2].color;
-            if (wire) glColor3f(1.f, 1.f, 1.f);
-            glBegin(wire ? GL_LINE_LOOP : GL_TRIANGLES);
-            glColor3f(c0.x, c0.y, c0.z);
-            if (!wire)glNormal3f(n0.x, n0.y, n0.z);
-            glVertex3f( v0.x, v0.y, v0.z);
-            
-            glColor3f(c1.x, c1.y, c1.z);
-            if (!wire)glNormal3f(n1.x, n1.y, n1.z);
-            glVertex3f( v1.x, v1.y, v1.z);
-
-            glColor3f(c2.x, c2.y, c2.z);
-            if (!wire)glNormal3f(n2.x, n2.y, n2.z);
-            glVertex3f( v2.x, v2.y, v2.z);
-            glEnd();
+            glEnableClientState(GL_NORMAL_ARRAY);
+            glNormalPointer(GL_FLOAT, packed.stride, base + packed.normalOffset);
         }
-        
+        else
+        {
+            glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+        }
+        glDrawElements(GL_TRIANGLES, packed.indexCount, packed.indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, packed.indices.data());
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        glDisableClientState(GL_NORMAL_ARRAY);
+        glDisableClientState(GL_COLOR_ARRAY);
+        glDisableClientState(GL_VERTEX_ARRAY);
     }
 
     glFrontFace(GL_CCW);
@@ -278,6 +201,8 @@ static void shapesPrintf(int row, int col, const char* fmt, ...)
 static void DrawSizeInfo(int* row)
 {
     //shapesPrintf((*row)++, 1, "Height  Up  Down : %f", orad);
+    if (function_index == 3)
+        shapesPrintf((*row)++, 1, "Sphere radius + - : %.2f", thing4Radius);
 }
 
 static void drawInfo()
@@ -415,6 +340,7 @@ static void
 key(unsigned char key, int x, int y)
 {
     int old_csg = csg_op;
+    float old_radius = thing4Radius;
     switch (key)
     {
     case 27:
@@ -428,10 +354,10 @@ key(unsigned char key, int x, int y)
     case 'i': show_info = !show_info;       break;
 
     case '=':
-    case '+': break;
+    case '+': if (function_index == 3) thing4Radius += 0.05f; break;
 
     case '-':
-    case '_': break;
+    case '_': if (function_index == 3 && thing4Radius > 0.1f) thing4Radius -= 0.05f; break;
 
     case ',':
     case '<': break;
@@ -447,7 +373,7 @@ key(unsigned char key, int x, int y)
     default:
         break;
     }
-    if (old_csg != csg_op)
+    if (old_csg != csg_op || old_radius != thing4Radius)
     {
         need_recalc = true;
     }
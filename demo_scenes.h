@@ -0,0 +1,99 @@
+#pragma once
+
+#include "csg.hpp"
+#include "csg_expr.h"
+
+// Example scenes shared by the demo and the benchmarks.
+
+namespace csghpp
+{
+	inline CSG makeThing(float x, float y, int csg_op)
+	{
+		//auto a = CSG::cube(vec3(x, y, .5));
+		//auto b = CSG::sphere(vec3(0,0, .0f), 1.0, 8, 6);
+		//auto b = CSG::cube(vec3(-.25 , -.25 , -.25));
+		//auto b = CSG::cylinder(0.3f, vec3(-2.f, 0, 0), vec3(2.f, 0, 0));
+		//auto b = CSG::sphere(vec3(.25, .25, .25), 1.0, 8, 6);
+		auto a = CSG::cylinder(0.3f, vec3(x, -1.f, y), vec3(0.f, 1.f, 0));
+		auto b = CSG::cylinder(0.3f, vec3(-1.f, 0, 0), vec3(1.f, 0, 0));
+		a.setColor(1, 1, 0);
+		b.setColor(0, 0.5, 1);
+		CSG c;
+		if (csg_op == 0)
+			c = a.unionOp(b);
+		else if (csg_op == 1)
+			c = a.subOp(b);
+		else
+			c = a.intersectOp(b);
+		return c;
+	}
+
+	inline CSG makeThing2()
+	{
+		auto a = CSG::cube(vec3(-.25, -.25, -.25));
+		auto b = CSG::sphere(vec3(.25, .25, .25), 1.3);
+
+		a.setColor(1, 1, 0);
+		b.setColor(0, 0.5, 1);
+		return a.subOp(b);
+	}
+
+	inline CSG makeThing3()
+	{
+		auto a = CSG::cube(vec3(-.25, -.25, -.25));
+		auto b = CSG::sphere(vec3(.25, .25, .25), 1.3);
+		a.setColor(1, 1, 0);
+		b.setColor(0, 0.5, 1);
+		return a.intersectOp(b);
+	}
+
+	inline CSG makeThing4()
+	{
+		// Generate example from wikipedia
+		auto a = CSG::cube();
+		auto b = CSG::sphere(vec3(0.f), 1.35, 12);
+		auto c = CSG::cylinder(0.7f, vec3(-1.f, 0, 0), vec3(1.f, 0, 0));
+		auto d = CSG::cylinder(0.7f, vec3(0, -1, 0), vec3(0, 1, 0));
+		auto e = CSG::cylinder(0.7f, vec3(0, 0, -1), vec3(0, 0, 1));
+
+		a.setColor(1, 0, 0);
+		b.setColor(0, 0, 1);
+		c.setColor(0, 1, 0);
+		d.setColor(0, 1, 0);
+		e.setColor(0, 1, 0);
+
+		return a.intersectOp(b).subOp((c.unionOp(d).unionOp(e)));
+	}
+
+	inline CSG makeThing5()
+	{
+		// Generate example from wikipedia
+		auto a = CSG::cube(vec3(0.f), 20.f);
+		auto b = CSG::cube(vec3(0.f), 19.f);
+		auto c = CSG::cube(vec3(0.5f), 0.5f);
+		auto d = CSG::cube(vec3(-0.5f), .5f);
+		auto e = CSG::cube(vec3(-0.5f, -.5, -10.5), vec3(1.f, 10.f, 1.f));
+
+		a.setColor(1, 0, 0);
+		b.setColor(0, 0, 1);
+		c.setColor(0, 1, 0);
+		d.setColor(0, 1, 0);
+		e.setColor(0, 1, 0);
+
+		return a.subOp(b).unionOp(c).unionOp(d).unionOp(e);
+	}
+
+	// makeThing4 as an expression. 'sphere' is set to its sphere, which can be
+	// changed with set() to re-evaluate only the operations that depend on it.
+	inline CSGExpr makeThing4Expr(CSGExpr& sphere)
+	{
+		auto a = CSGExpr::cube().setColor(1, 0, 0);
+		sphere = CSGExpr::sphere(vec3(0.f), 1.35f, 12).setColor(0, 0, 1);
+		auto c = CSGExpr::cylinder(0.7f, vec3(-1.f, 0, 0), vec3(1.f, 0, 0)).setColor(0, 1, 0);
+		auto d = CSGExpr::cylinder(0.7f, vec3(0, -1, 0), vec3(0, 1, 0)).setColor(0, 1, 0);
+		auto e = CSGExpr::cylinder(0.7f, vec3(0, 0, -1), vec3(0, 0, 1)).setColor(0, 1, 0);
+
+		return a.intersectOp(sphere).subOp(c.unionOp(d).unionOp(e));
+	}
+
+} // namespace csghpp
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cmath>
+
 typedef float real;
 
 struct ivec2 {
@@ -9,90 +11,125 @@ struct ivec2 {
   int x,y;
 };
 
-struct vec2 {
-  vec2() : x(0.f), y(0.f) {}
-  vec2(real v) : x(v), y(v) {}
-  vec2(real x, real y) : x(x), y(y) {}
-  real x,y;
+template<typename T>
+struct tvec2 {
+  typedef T value_type;
+
+  tvec2() : x(0), y(0) {}
+  tvec2(T v) : x(v), y(v) {}
+  tvec2(T x, T y) : x(x), y(y) {}
+  T x,y;
 };
 
-real dot(const vec2 a, const vec2 b)
+// Scalar arguments use value_type, so that e.g. a float literal can be
+// passed along with double vectors
+template<typename T>
+T dot(const tvec2<T> a, const tvec2<T> b)
 {
   return a.x*b.x + a.y*b.y;
 }
 
-vec2 operator-(vec2 a, vec2 b)
+template<typename T>
+tvec2<T> operator-(tvec2<T> a, tvec2<T> b)
+{
+  return tvec2<T>(a.x-b.x, a.y-b.y);
+}
+
+template<typename T>
+tvec2<T> operator+(tvec2<T> a, tvec2<T> b)
 {
-  return vec2(a.x-b.x, a.y-b.y);
+  return tvec2<T>(a.x+b.x, a.y+b.y);
 }
 
-struct vec3 {
-  vec3() : x(0.f), y(0.f), z(0.f){}
-  vec3(real v) : x(v), y(v), z(v) {}
-  vec3(real x, real y) : x(x), y(y), z(0.f) {}
-  vec3(real x, real y, real z) : x(x), y(y), z(z) {}
+template<typename T>
+tvec2<T> operator*(tvec2<T> a, typename tvec2<T>::value_type s)
+{
+  return tvec2<T>(a.x*s, a.y*s);
+}
+
+template<typename T>
+struct tvec3 {
+  typedef T value_type;
 
-  real dot(const vec3 b) const
+  tvec3() : x(0), y(0), z(0){}
+  tvec3(T v) : x(v), y(v), z(v) {}
+  tvec3(T x, T y) : x(x), y(y), z(0) {}
+  tvec3(T x, T y, T z) : x(x), y(y), z(z) {}
+
+  T dot(const tvec3 b) const
   {
       return x * b.x + y * b.y + z * b.z;
   }
 
-  real length() const
+  T length() const
   {
-      return sqrtf( this->dot(*this) );
+      return std::sqrt( this->dot(*this) );
   }
 
-  vec3 unit() const
+  tvec3 unit() const
   {
-      real rlen = 1.0f / length();
-      return vec3(x * rlen, y * rlen, z*rlen);
+      T rlen = T(1) / length();
+      return tvec3(x * rlen, y * rlen, z*rlen);
   }
 
-  vec3 cross(vec3 b) const
+  tvec3 cross(tvec3 b) const
   {
-      vec3 a = *this;
-      return vec3(
+      tvec3 a = *this;
+      return tvec3(
           a.y * b.z - a.z * b.y,
           a.z * b.x - a.x * b.z,
           a.x * b.y - a.y * b.x);
   }
 
-  real x,y,z;
+  T x,y,z;
 };
 
-real dot(const vec3 a, const vec3 b)
+typedef tvec2<real> vec2;
+typedef tvec3<real> vec3;
+typedef tvec2<double> dvec2;
+typedef tvec3<double> dvec3;
+
+template<typename T>
+T dot(const tvec3<T> a, const tvec3<T> b)
 {
     return a.dot(b);
 }
 
-vec3 operator/(vec3 a, real v)
+template<typename T>
+tvec3<T> operator/(tvec3<T> a, typename tvec3<T>::value_type v)
 {
-  return vec3(a.x/v, a.y/v, a.z/v);
+  return tvec3<T>(a.x/v, a.y/v, a.z/v);
 }
 
-vec3 operator-(vec3 a)
+template<typename T>
+tvec3<T> operator-(tvec3<T> a)
 {
-    return vec3(-a.x, -a.y, -a.z);
+    return tvec3<T>(-a.x, -a.y, -a.z);
 }
-vec3 operator+(vec3 a, vec3 b)
+template<typename T>
+tvec3<T> operator+(tvec3<T> a, tvec3<T> b)
 {
-    return vec3(a.x + b.x, a.y + b.y, a.z + b.z);
+    return tvec3<T>(a.x + b.x, a.y + b.y, a.z + b.z);
 }
-vec3 operator-(vec3 a, vec3 b)
+template<typename T>
+tvec3<T> operator-(tvec3<T> a, tvec3<T> b)
 {
-    return vec3(a.x - b.x, a.y - b.y, a.z - b.z);
+    return tvec3<T>(a.x - b.x, a.y - b.y, a.z - b.z);
 }
-vec3 operator*(vec3 a, real s)
+template<typename T>
+tvec3<T> operator*(tvec3<T> a, typename tvec3<T>::value_type s)
 {
-    return vec3(a.x * s, a.y * s, a.z * s);
+    return tvec3<T>(a.x * s, a.y * s, a.z * s);
 }
-vec3 lerp(vec3 a, vec3 b, real t)
+template<typename T>
+tvec3<T> lerp(tvec3<T> a, tvec3<T> b, typename tvec3<T>::value_type t)
 {
     return a + (b - a) * t;
 }
-vec3 cross(vec3 a, vec3 b)
+template<typename T>
+tvec3<T> cross(tvec3<T> a, tvec3<T> b)
 {
-    return vec3(
+    return tvec3<T>(
         a.y * b.z - a.z * b.y,
         a.z * b.x - a.x * b.z,
         a.x * b.y - a.y * b.x);